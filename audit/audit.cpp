@@ -0,0 +1,183 @@
+/*************************************************************************
+* detouring_audit
+* An LD_AUDIT library that redirects symbol bindings to the detours
+* registered through DETOURING_AUDIT_HOOKS, without patching any code.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "audit.hpp"
+#include "elf.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct HookTable
+	{
+		const link_map *owner;
+		Detouring::DynamicInfo info;
+		Detouring::AuditHook *hooks;
+	};
+
+	// The audit library lives in its own namespace and is never unloaded
+	std::mutex tables_mutex;
+	std::vector<HookTable> tables;
+
+	bool IsModuleName( const char *name, const char *path )
+	{
+		if( name[0] == '\0' )
+			return true;
+
+		if( path == nullptr || path[0] == '\0' )
+			return false;
+
+		const char *slash = std::strrchr( path, '/' );
+		return std::strcmp( name, path ) == 0 || std::strcmp( name, slash != nullptr ? slash + 1 : path ) == 0;
+	}
+
+	uintptr_t BindSymbol( uintptr_t address, uintptr_t *refcook, uintptr_t *defcook, unsigned int *flags, const char *name )
+	{
+		// No pltenter or pltexit callbacks, so bound calls go straight through
+		*flags |= LA_SYMB_NOPLTENTER | LA_SYMB_NOPLTEXIT;
+
+		const link_map *from = reinterpret_cast<const link_map *>( *refcook );
+		const link_map *to = reinterpret_cast<const link_map *>( *defcook );
+
+		std::lock_guard lock( tables_mutex );
+		for( const HookTable &table : tables )
+		{
+			// The module registering the detours keeps calling the originals
+			if( table.owner == from )
+				continue;
+
+			for( Detouring::AuditHook *hook = table.hooks; hook->target[0] != '\0'; ++hook )
+			{
+				if( std::strcmp( hook->target, name ) != 0 || !IsModuleName( hook->module, to->l_name ) )
+					continue;
+
+				const ElfW( Sym ) *detour =
+					Detouring::FindDynamicSymbol( table.info, hook->detour, Detouring::GetGNUHash( hook->detour ) );
+				if( detour == nullptr )
+					continue;
+
+				if( hook->original == nullptr )
+					hook->original = reinterpret_cast<void *>( address );
+
+				return table.info.base + detour->st_value;
+			}
+		}
+
+		return address;
+	}
+}
+
+extern "C"
+{
+	__attribute__( ( visibility( "default" ) ) ) unsigned int la_version( unsigned int version )
+	{
+		return version < LAV_CURRENT ? version : LAV_CURRENT;
+	}
+
+	__attribute__( ( visibility( "default" ) ) ) unsigned int la_objopen( link_map *map, Lmid_t, uintptr_t *cookie )
+	{
+		*cookie = reinterpret_cast<uintptr_t>( map );
+
+		// Only mapped at this point, which is enough since the table has no relocations
+		Detouring::DynamicInfo info;
+		if( Detouring::GetDynamicInfo( static_cast<uintptr_t>( map->l_addr ), map->l_ld, info ) )
+		{
+			const ElfW( Sym ) *symbol = Detouring::FindDynamicSymbol(
+				info,
+				"detouring_audit_hooks",
+				Detouring::GetGNUHash( "detouring_audit_hooks" )
+			);
+			if( symbol != nullptr )
+			{
+				std::lock_guard lock( tables_mutex );
+				tables.push_back( {
+					map,
+					info,
+					reinterpret_cast<Detouring::AuditHook *>( info.base + symbol->st_value )
+				} );
+			}
+		}
+
+		return LA_FLG_BINDTO | LA_FLG_BINDFROM;
+	}
+
+	__attribute__( ( visibility( "default" ) ) ) unsigned int la_objclose( uintptr_t *cookie )
+	{
+		std::lock_guard lock( tables_mutex );
+		for( auto it = tables.begin( ); it != tables.end( ); ++it )
+			if( reinterpret_cast<uintptr_t>( it->owner ) == *cookie )
+			{
+				tables.erase( it );
+				break;
+			}
+
+		return 0;
+	}
+
+#if defined __x86_64__
+
+	__attribute__( ( visibility( "default" ) ) ) uintptr_t la_symbind64(
+		Elf64_Sym *symbol,
+		unsigned int,
+		uintptr_t *refcook,
+		uintptr_t *defcook,
+		unsigned int *flags,
+		const char *name
+	)
+	{
+		return BindSymbol( static_cast<uintptr_t>( symbol->st_value ), refcook, defcook, flags, name );
+	}
+
+#else
+
+	__attribute__( ( visibility( "default" ) ) ) uintptr_t la_symbind32(
+		Elf32_Sym *symbol,
+		unsigned int,
+		uintptr_t *refcook,
+		uintptr_t *defcook,
+		unsigned int *flags,
+		const char *name
+	)
+	{
+		return BindSymbol( static_cast<uintptr_t>( symbol->st_value ), refcook, defcook, flags, name );
+	}
+
+#endif
+
+}
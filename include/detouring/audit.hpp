@@ -0,0 +1,86 @@
+/*************************************************************************
+* Detouring::AuditHook
+* Bind time hook registrations for the detouring_audit library, which is
+* loaded through LD_AUDIT on Linux.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include <cstring>
+
+namespace Detouring
+{
+	// Bindings happen before constructors run and before the registering
+	// module is relocated, so the table holds names instead of pointers.
+	// The detour must be exported (extern "C", and -rdynamic when the table
+	// lives in the executable). An empty module matches every module.
+	struct AuditHook
+	{
+		char module[64];
+		char target[128];
+		char detour[128];
+
+		// Written by the audit library once the target is bound
+		void *volatile original;
+	};
+}
+
+// Exported so the audit library finds the table of each module, but
+// protected so every module reads its own instead of the first one loaded
+extern "C" __attribute__( ( visibility( "protected" ) ) ) Detouring::AuditHook detouring_audit_hooks[];
+
+// Defines the table (with the C linkage declared above), once per module
+#define DETOURING_AUDIT_HOOKS( ... )	\
+	__attribute__( ( visibility( "protected" ) ) ) Detouring::AuditHook detouring_audit_hooks[] = { __VA_ARGS__, { } }
+
+#define DETOURING_AUDIT_HOOK( MODULE, TARGET, DETOUR ) { MODULE, TARGET, #DETOUR, nullptr }
+
+namespace Detouring
+{
+	// Calls made by the module holding the table bind to the original, so
+	// this is only needed to reach it from a detour
+	inline void *GetAuditOriginal( const char *target )
+	{
+		for( AuditHook *hook = detouring_audit_hooks; hook->target[0] != '\0'; ++hook )
+			if( std::strcmp( hook->target, target ) == 0 )
+				return hook->original;
+
+		return nullptr;
+	}
+
+	template<typename Method>
+	inline Method GetAuditOriginal( const char *target )
+	{
+		return reinterpret_cast<Method>( GetAuditOriginal( target ) );
+	}
+}
@@ -0,0 +1,149 @@
+/*************************************************************************
+* Detouring::ResolutionCache
+* A C++ class that persists resolved symbols, signatures and virtual
+* table indices across runs.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+#include "helpers.hpp"
+#include "signature.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+namespace Detouring
+{
+	class MappedFile;
+
+	// Entries are stored relative to their module and keyed by its build
+	// identifier, so they are ignored (and dropped on the next save) as soon
+	// as the module is rebuilt. The file is mapped and searched in place.
+	class ResolutionCache
+	{
+	public:
+		ResolutionCache( );
+		ResolutionCache( const std::string &path );
+
+		ResolutionCache( const ResolutionCache & ) = delete;
+
+		~ResolutionCache( );
+
+		ResolutionCache &operator=( const ResolutionCache & ) = delete;
+
+		// A missing or invalid file results in an empty cache
+		bool Load( const std::string &path );
+
+		// Writes to a temporary file, flushed to the disk, which then replaces
+		// the loaded one
+		bool Save( );
+
+		const std::string &GetPath( ) const;
+		size_t GetSize( ) const;
+		bool IsDirty( ) const;
+
+		void *FindSymbol( const Hook::Module &module, const std::string &name );
+		bool AddSymbol( const Hook::Module &module, const std::string &name, void *address );
+
+		void *FindSignature( const Hook::Module &module, const Signature &signature );
+		bool AddSignature( const Hook::Module &module, const Signature &signature, void *address );
+
+		bool FindVirtualIndex( const Hook::Module &module, const std::string &name, size_t &index );
+		bool AddVirtualIndex( const Hook::Module &module, const std::string &name, size_t index );
+
+		// The module is the one the virtual table belongs to
+		template<
+			typename Definition,
+			typename Traits = FunctionTraits<Definition>,
+			std::enable_if_t<Traits::IsMemberFunctionPointer, int> = 0
+		>
+		Member GetVirtualAddress(
+			const Hook::Module &module,
+			const std::string &name,
+			void **vtable,
+			size_t size,
+			Definition method
+		)
+		{
+			size_t index = 0;
+			if( FindVirtualIndex( module, name, index ) && index < size )
+				return Member( index, vtable[index] );
+
+			Member member = Detouring::GetVirtualAddress( vtable, size, method );
+			if( member.IsValid( ) )
+				AddVirtualIndex( module, name, member.index );
+
+			return member;
+		}
+
+	private:
+		struct Entry
+		{
+			uint64_t module;
+			uint64_t build;
+			uint64_t key;
+			uint64_t value;
+		};
+
+		struct ModuleKey
+		{
+			uint64_t module;
+			uint64_t build;
+			uintptr_t base;
+			uintptr_t end;
+		};
+
+		// Maps the file at path, with the mutex already held
+		bool LoadLocked( );
+
+		bool GetModuleKey( const Hook::Module &module, ModuleKey &key );
+		bool Find( const Hook::Module &module, uint64_t key, bool is_offset, uint64_t &value );
+		bool Add( const Hook::Module &module, uint64_t key, bool is_offset, uint64_t value );
+
+		std::string path;
+		std::unique_ptr<MappedFile> file;
+		const Entry *entries = nullptr;
+		size_t entry_count = 0;
+		std::unordered_map<uint64_t, uint64_t> builds;
+		std::map<std::pair<uint64_t, uint64_t>, Entry> added;
+		bool dirty = false;
+		mutable std::mutex mutex;
+	};
+}
@@ -38,22 +38,28 @@
 #pragma once
 
 #include "hook.hpp"
+#include "transaction.hpp"
+#include "epoch.hpp"
 #include "helpers.hpp"
+#include "flatmap.hpp"
 #include "platform.hpp"
 
 #include <cstdint>
 #include <cstddef>
 #include <vector>
-#include <unordered_map>
+#include <algorithm>
 #include <utility>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
 #include <stdexcept>
 
 namespace Detouring
 {
-	typedef std::unordered_map<void *, Member> CacheMap;
-	typedef std::unordered_map<void *, Detouring::Hook> HookMap;
+	typedef FlatMap<Member> CacheMap;
+	typedef FlatMap<std::unique_ptr<Detouring::Hook>> HookMap;
 
 	template<typename Target, typename Substitute>
 	class ClassProxy
@@ -71,7 +77,7 @@ namespace Detouring
 	public:
 		static bool Initialize( Target *instance, Substitute *substitute )
 		{
-			auto shared_state = GetSharedState( );
+			const auto shared_state = GetSharedState( );
 			if( !shared_state )
 				return false;
 
@@ -99,7 +105,7 @@ namespace Detouring
 			if( !shared_state )
 				return false;
 
-			return shared_state->hooks.find( reinterpret_cast<void*>( original ) ) != shared_state->hooks.end( );
+			return shared_state->HasHook( reinterpret_cast<void *>( original ) );
 		}
 
 		template<
@@ -113,15 +119,86 @@ namespace Detouring
 			if( !shared_state )
 				return false;
 
-			const auto it = shared_state->hooks.find( GetAddress( original ) );
-			if( it != shared_state->hooks.end( ) )
+			if( shared_state->HasHook( GetAddress( original ) ) )
 				return true;
 
 			Member vtarget = GetVirtualAddress( shared_state->target_vtable, original );
 			if( !vtarget.IsValid( ) )
 				return false;
 
-			return shared_state->target_vtable.pointer[vtarget.index] != shared_state->original_vtable[vtarget.index];
+			return shared_state->GetHookedFunction( vtarget.index ) != shared_state->original_vtable[vtarget.index];
+		}
+
+		// Copies the virtual table into a private buffer, which virtual
+		// method hooks modify from then on instead of the shared one.
+		// Only instances swapped with Shadow call the substitutes.
+		// Must be used before hooking any virtual method. Only the Itanium
+		// C++ ABI table layout is handled, so this always fails with MSVC.
+		static bool EnableShadowVTable( )
+		{
+			const auto shared_state = GetSharedState( );
+			if( !shared_state )
+				return false;
+
+			return shared_state->EnableShadowVTable( );
+		}
+
+		static bool IsShadowVTableEnabled( )
+		{
+			const auto shared_state = GetSharedState( );
+			if( !shared_state )
+				return false;
+
+			return shared_state->shadow_vtable.load( std::memory_order_acquire ) != nullptr;
+		}
+
+		// Points the instance to the shadow virtual table.
+		// Instances must be restored with Unshadow before being destroyed,
+		// and the shadow table is leaked for those left when the state goes.
+		static bool Shadow( Target *instance )
+		{
+			const auto shared_state = GetSharedState( );
+			if( !shared_state || instance == nullptr || shared_state->shadow_vtable.load( std::memory_order_acquire ) == nullptr )
+				return false;
+
+			std::lock_guard lock( shared_state->shadow_mutex );
+			void **&vtable = *reinterpret_cast<void ***>( instance );
+			if( vtable == shared_state->GetHookedVTable( ) )
+				return true;
+
+			if( vtable != shared_state->target_vtable.pointer )
+				return false;
+
+			vtable = shared_state->GetHookedVTable( );
+			shared_state->shadowed_instances.push_back( instance );
+			return true;
+		}
+
+		static bool Unshadow( Target *instance )
+		{
+			const auto shared_state = GetSharedState( );
+			if( !shared_state || instance == nullptr )
+				return false;
+
+			std::lock_guard lock( shared_state->shadow_mutex );
+			auto &instances = shared_state->shadowed_instances;
+			const auto it = std::find( instances.begin( ), instances.end( ), instance );
+			if( it == instances.end( ) )
+				return false;
+
+			*reinterpret_cast<void ***>( instance ) = shared_state->target_vtable.pointer;
+			*it = instances.back( );
+			instances.pop_back( );
+			return true;
+		}
+
+		static bool IsShadowed( Target *instance )
+		{
+			const auto shared_state = GetSharedState( );
+			if( !shared_state || instance == nullptr || shared_state->shadow_vtable.load( std::memory_order_acquire ) == nullptr )
+				return false;
+
+			return GetVirtualTable( instance ) == shared_state->GetHookedVTable( );
 		}
 
 		template<
@@ -133,33 +210,20 @@ namespace Detouring
 		>
 		static bool Hook(
 			DefinitionOriginal original,
-			DefinitionSubstitute substitute
+			DefinitionSubstitute substitute,
+			HookTransaction *transaction = nullptr
 		)
 		{
 			const auto shared_state = GetSharedState( );
 			if( !shared_state )
 				return false;
 
-			void *address = reinterpret_cast<void *>( original );
-			if( address == nullptr )
-				return false;
-
-			const auto it = shared_state->hooks.find( address );
-			if( it != shared_state->hooks.end( ) )
-				return true;
-
-			void *subst = GetAddress( substitute );
-			if( subst == nullptr )
-				return false;
-
-			Detouring::Hook &hook = shared_state->hooks[address];
-			if( !hook.Create( address, subst ) )
-			{
-				shared_state->hooks.erase( address );
-				return false;
-			}
-
-			return hook.Enable( );
+			return HookFunction(
+				*shared_state,
+				reinterpret_cast<void *>( original ),
+				GetAddress( substitute ),
+				transaction
+			);
 		}
 
 		template<
@@ -171,7 +235,8 @@ namespace Detouring
 		>
 		static bool Hook(
 			DefinitionOriginal original,
-			DefinitionSubstitute substitute
+			DefinitionSubstitute substitute,
+			HookTransaction *transaction = nullptr
 		)
 		{
 			const auto shared_state = GetSharedState( );
@@ -181,40 +246,18 @@ namespace Detouring
 			Member target = GetVirtualAddress( shared_state->target_vtable, original );
 			if( target.IsValid( ) )
 			{
-				if( shared_state->target_vtable.pointer[target.index] != shared_state->original_vtable[target.index] )
+				if( shared_state->GetHookedFunction( target.index ) != shared_state->original_vtable[target.index] )
 					return true;
 
 				Member subst = GetVirtualAddress( shared_state->substitute_vtable, substitute );
 				if( !subst.IsValid( ) )
 					return false;
 
-				ProtectMemory( shared_state->target_vtable.pointer + target.index, sizeof( void * ), false );
-				shared_state->target_vtable.pointer[target.index] = subst.address;
-				ProtectMemory( shared_state->target_vtable.pointer + target.index, sizeof( void * ), true );
-
-				return true;
-			}
-
-			void *address = GetAddress( original );
-			if( address == nullptr )
-				return false;
-
-			const auto it = shared_state->hooks.find( address );
-			if( it != shared_state->hooks.end( ) )
+				shared_state->SetVirtualFunction( target.index, subst.address );
 				return true;
-
-			void *subst = GetAddress( substitute );
-			if( subst == nullptr )
-				return false;
-
-			Detouring::Hook &hook = shared_state->hooks[address];
-			if( !hook.Create( address, subst ) )
-			{
-				shared_state->hooks.erase( address );
-				return false;
 			}
 
-			return hook.Enable( );
+			return HookFunction( *shared_state, GetAddress( original ), GetAddress( substitute ), transaction );
 		}
 
 		template<
@@ -228,10 +271,10 @@ namespace Detouring
 			if( !shared_state )
 				return false;
 
-			const auto it = shared_state->hooks.find( reinterpret_cast<void *>( original ) );
-			if( it != shared_state->hooks.end( ) )
+			// Destroyed once the slots no longer point to its trampoline
+			if( const auto hook = shared_state->TakeHook( reinterpret_cast<void *>( original ) ) )
 			{
-				shared_state->hooks.erase( it );
+				shared_state->InvalidateSlots( );
 				return true;
 			}
 
@@ -249,10 +292,9 @@ namespace Detouring
 			if( !shared_state )
 				return false;
 
-			const auto it = shared_state->hooks.find( GetAddress( original ) );
-			if( it != shared_state->hooks.end( ) )
+			if( const auto hook = shared_state->TakeHook( GetAddress( original ) ) )
 			{
-				shared_state->hooks.erase( it );
+				shared_state->InvalidateSlots( );
 				return true;
 			}
 
@@ -261,13 +303,10 @@ namespace Detouring
 				return false;
 
 			void *vfunction = shared_state->original_vtable[target.index];
-			if( shared_state->target_vtable.pointer[target.index] == vfunction )
+			if( shared_state->GetHookedFunction( target.index ) == vfunction )
 				return false;
 
-			ProtectMemory( shared_state->target_vtable.pointer + target.index, sizeof( void * ), false );
-			shared_state->target_vtable.pointer[target.index] = vfunction;
-			ProtectMemory( shared_state->target_vtable.pointer + target.index, sizeof( void * ), true );
-
+			shared_state->SetVirtualFunction( target.index, vfunction );
 			return true;
 		}
 
@@ -284,23 +323,23 @@ namespace Detouring
 			Args &&... args
 		)
 		{
-			const auto shared_state = GetSharedState( );
-			if( !shared_state )
-				return ReturnType( );
-
-			void *address = reinterpret_cast<void *>( original ), *target = nullptr;
-			const auto it = shared_state->hooks.find( address );
-			if( it != shared_state->hooks.end( ) )
-				target = it->second.GetTrampoline( );
+			// The shared state guard is left before the original runs, so a long
+			// call never holds up its destruction, while the epoch guard keeps
+			// the trampoline alive if the hook is destroyed meanwhile
+			const EpochGuard epoch;
+			void *target = nullptr;
+			{
+				const auto shared_state = GetSharedState( );
+				if( !shared_state )
+					return ReturnType( );
 
-			if( target == nullptr )
-				target = address;
+				target = GetOriginalAddress( *shared_state, original );
+			}
 
 			if( target == nullptr )
 				return ReturnType( );
 
-			auto method = reinterpret_cast<Definition>( target );
-			return method( instance, std::forward<Args>( args )... );
+			return Invoke<Definition>( target, instance, std::forward<Args>( args )... );
 		}
 
 		template<
@@ -316,58 +355,239 @@ namespace Detouring
 			Args &&... args
 		)
 		{
-			const auto shared_state = GetSharedState( );
-			if( !shared_state )
+			// The shared state guard is left before the original runs, so a long
+			// call never holds up its destruction, while the epoch guard keeps
+			// the trampoline alive if the hook is destroyed meanwhile
+			const EpochGuard epoch;
+			void *target = nullptr;
+			{
+				const auto shared_state = GetSharedState( );
+				if( !shared_state )
+					return ReturnType( );
+
+				target = GetOriginalAddress( *shared_state, original );
+			}
+
+			if( target == nullptr )
 				return ReturnType( );
 
-			void *address = GetAddress( original );
-			void *final_address = nullptr;
-			const auto it = shared_state->hooks.find( address );
-			if( it != shared_state->hooks.end( ) )
-				final_address = it->second.GetTrampoline( );
+			return Invoke<Definition>( target, instance, std::forward<Args>( args )... );
+		}
 
-			if( final_address == nullptr )
+		template<
+			typename Definition,
+			typename... Args,
+			typename Traits = FunctionTraits<Definition>,
+			typename ReturnType = typename Traits::ReturnType
+		>
+		inline ReturnType Call( Definition original, Args &&... args )
+		{
+			return Call( This( ), original, std::forward<Args>( args )... );
+		}
+
+		// Same as Call but the original is resolved once into a slot per
+		// method, which is reset by Hook and UnHook, so the common case
+		// costs one load and an indirect call.
+		// For example: Call<&Target::Method>( instance, arguments... )
+		template<
+			auto Original,
+			typename... Args,
+			typename Definition = decltype( Original ),
+			typename Traits = FunctionTraits<Definition>,
+			typename ReturnType = typename Traits::ReturnType,
+			std::enable_if_t<
+				sizeof...( Args ) + ( Traits::IsMemberFunctionPointer ? 0 : 1 ) ==
+					std::tuple_size_v<typename Traits::ArgTypes>,
+				int
+			> = 0
+		>
+		static ReturnType Call( Target *instance, Args &&... args )
+		{
+			// Entered before the slot is read, which UnHook resets before the
+			// hook is destroyed
+			const EpochGuard epoch;
+			void *target = ResolvedSlot<Original>::address.load( std::memory_order_acquire );
+			if( target == nullptr )
 			{
-				Member member = GetVirtualAddress( shared_state->target_vtable, original );
-				if( member.IsValid( ) )
-					final_address = shared_state->original_vtable[member.index];
+				target = ResolveSlot<Original>( );
+				if( target == nullptr )
+					return ReturnType( );
 			}
 
-			if( final_address == nullptr )
+			return Invoke<Definition>( target, instance, std::forward<Args>( args )... );
+		}
+
+		template<
+			auto Original,
+			typename... Args,
+			typename Definition = decltype( Original ),
+			typename Traits = FunctionTraits<Definition>,
+			typename ReturnType = typename Traits::ReturnType,
+			std::enable_if_t<
+				sizeof...( Args ) + ( Traits::IsMemberFunctionPointer ? 0 : 1 ) ==
+					std::tuple_size_v<typename Traits::ArgTypes>,
+				int
+			> = 0
+		>
+		inline ReturnType Call( Args &&... args )
+		{
+			return Call<Original>( This( ), std::forward<Args>( args )... );
+		}
+
+	private:
+		class SharedState;
+
+		// Detours are created right away but, when a transaction is given,
+		// only enabled and reported by IsHooked once it is committed
+		static bool HookFunction(
+			SharedState &shared_state,
+			void *address,
+			void *substitute,
+			HookTransaction *transaction
+		)
+		{
+			if( address == nullptr )
+				return false;
+
+			if( shared_state.HasHook( address ) )
+				return true;
+
+			if( substitute == nullptr )
+				return false;
+
+			auto hook = std::make_unique<Detouring::Hook>( );
+			if( !hook->Create( address, substitute ) )
+				return false;
+
+			if( transaction == nullptr )
 			{
-				if( address == nullptr )
-					return ReturnType( );
+				// Another thread hooked it first, and this one is dropped
+				Detouring::Hook &created = *hook;
+				if( !shared_state.AddHook( address, hook ) )
+					return true;
 
-				final_address = address;
+				shared_state.InvalidateSlots( );
+				return created.Enable( );
 			}
 
+			// Owned by the transaction until it commits, so an abort or a failed
+			// commit never leaves a disabled hook behind in the map
+			if( !transaction->Enable( *hook ) )
+				return false;
+
+			transaction->Adopt( std::move( hook ), [address]( std::unique_ptr<Detouring::Hook> committed )
+			{
+				const auto shared_state = GetSharedState( );
+				if( shared_state && shared_state->AddHook( address, committed ) )
+					shared_state->InvalidateSlots( );
+			} );
+			return true;
+		}
+
+		template<
+			typename Definition,
+			typename Traits = FunctionTraits<Definition>,
+			std::enable_if_t<!Traits::IsMemberFunctionPointer, int> = 0
+		>
+		static void *GetOriginalAddress( SharedState &shared_state, Definition original )
+		{
+			void *address = reinterpret_cast<void *>( original );
+			void *trampoline = shared_state.GetTrampoline( address );
+			if( trampoline != nullptr )
+				return trampoline;
+
+			return address;
+		}
+
+		template<
+			typename Definition,
+			typename Traits = FunctionTraits<Definition>,
+			std::enable_if_t<Traits::IsMemberFunctionPointer, int> = 0
+		>
+		static void *GetOriginalAddress( SharedState &shared_state, Definition original )
+		{
+			void *address = GetAddress( original );
+			void *trampoline = shared_state.GetTrampoline( address );
+			if( trampoline != nullptr )
+				return trampoline;
+
+			Member member = GetVirtualAddress( shared_state.target_vtable, original );
+			if( member.IsValid( ) )
+				return shared_state.original_vtable[member.index];
+
+			return address;
+		}
+
+		template<
+			typename Definition,
+			typename... Args,
+			typename Traits = FunctionTraits<Definition>,
+			typename ReturnType = typename Traits::ReturnType,
+			std::enable_if_t<!Traits::IsMemberFunctionPointer, int> = 0
+		>
+		static inline ReturnType Invoke( void *target, Target *instance, Args &&... args )
+		{
+			auto method = reinterpret_cast<Definition>( target );
+			return method( instance, std::forward<Args>( args )... );
+		}
+
+		template<
+			typename Definition,
+			typename... Args,
+			typename Traits = FunctionTraits<Definition>,
+			typename ReturnType = typename Traits::ReturnType,
+			std::enable_if_t<Traits::IsMemberFunctionPointer, int> = 0
+		>
+		static inline ReturnType Invoke( void *target, Target *instance, Args &&... args )
+		{
 			struct CallMagic
 			{
 				const void *address = nullptr;
 				const size_t offset = 0;
 				const size_t unused[2] = { 0, 0 };
-			} func = { final_address };
+			} func = { target };
 			auto typedfunc = reinterpret_cast<Definition *>( &func );
 			return ( instance->**typedfunc )( std::forward<Args>( args )... );
 		}
 
-		template<
-			typename Definition,
-			typename... Args,
-			typename Traits = FunctionTraits<Definition>,
-			typename ReturnType = typename Traits::ReturnType
-		>
-		inline ReturnType Call( Definition original, Args &&... args )
+		template<auto Original>
+		struct ResolvedSlot
 		{
-			return Call( This( ), original, std::forward<Args>( args )... );
+			static inline std::atomic<void *> address = nullptr;
+		};
+
+		template<auto Original>
+		static void *ResolveSlot( )
+		{
+			const auto shared_state = GetSharedState( );
+			if( !shared_state )
+				return nullptr;
+
+			std::atomic<void *> &slot = ResolvedSlot<Original>::address;
+			const uint64_t generation = shared_state->slot_generation.load( std::memory_order_acquire );
+
+			void *target = GetOriginalAddress( *shared_state, Original );
+			if( target == nullptr )
+				return nullptr;
+
+			shared_state->RegisterSlot( slot );
+			slot.store( target, std::memory_order_release );
+
+			// A hook changed while resolving, so resolve again on the next call
+			if( shared_state->slot_generation.load( std::memory_order_acquire ) != generation )
+				slot.store( nullptr, std::memory_order_release );
+
+			return target;
 		}
 
-	private:
 		struct VTable
 		{
 			size_t size = 0;
 			void **pointer = nullptr;
+
+			// Concurrent calls resolve members while others fill the cache
 			CacheMap cache;
+			std::shared_mutex cache_mutex;
 		};
 
 		template<
@@ -381,14 +601,21 @@ namespace Detouring
 		)
 		{
 			void *member = GetAddress( method );
-			const auto it = vtable.cache.find( member );
-			if( it != vtable.cache.end( ) )
-				return it->second;
+
+			{
+				std::shared_lock lock( vtable.cache_mutex );
+				const auto it = vtable.cache.find( member );
+				if( it != vtable.cache.end( ) )
+					return it->second;
+			}
 
 			Member address = Detouring::GetVirtualAddress( vtable.pointer, vtable.size, method );
 
 			if( address.IsValid( ) )
+			{
+				std::unique_lock lock( vtable.cache_mutex );
 				vtable.cache[member] = address;
+			}
 
 			return address;
 		}
@@ -398,21 +625,24 @@ namespace Detouring
 		public:
 			~SharedState( )
 			{
-				if( target_vtable.pointer == nullptr || target_vtable.size == 0 )
-					return;
+				InvalidateSlots( );
 
-				ProtectMemory( target_vtable.pointer, target_vtable.size * sizeof( void * ), false );
+				// Instances still shadowed may be alive or already freed, so they
+				// are left alone. The table is leaked for them: freeing it would
+				// leave live ones calling through released memory, and nothing can
+				// tell when the last of them is gone to retire it later.
+				std::atomic<void *> *shadow = shadow_vtable.load( std::memory_order_acquire );
+				if( shadow != nullptr && shadowed_instances.empty( ) )
+					delete[] shadow;
 
-				void **vtable = target_vtable.pointer;
-				for(
-					auto it = original_vtable.begin( );
-					it != original_vtable.end( );
-					++vtable, ++it
-				)
-					if( *vtable != *it )
-						*vtable = *it;
+				if( target_vtable.pointer == nullptr || target_vtable.size == 0 )
+					return;
 
-				ProtectMemory( target_vtable.pointer, target_vtable.size * sizeof( void * ), true );
+				// Each changed entry is restored with a single pointer store, since
+				// other threads may still be calling through the table
+				for( size_t index = 0; index < target_vtable.size; ++index )
+					if( target_vtable.pointer[index] != original_vtable[index] )
+						WriteProtectedMemory( target_vtable.pointer + index, &original_vtable[index], sizeof( void * ) );
 			}
 
 			bool Initialize( Target *instance, Substitute *substitute )
@@ -424,13 +654,40 @@ namespace Detouring
 				if( target_vtable.pointer == nullptr )
 					return false;
 
+				// Never read past the region holding the virtual table
+				MemoryRegion region;
+				if(
+					!GetMemoryRegion( target_vtable.pointer, region ) ||
+					( region.protection & MemoryProtection::Read ) == 0
+				)
+				{
+					target_vtable.pointer = nullptr;
+					return false;
+				}
+
+				const size_t limit =
+					( region.end - reinterpret_cast<uintptr_t>( target_vtable.pointer ) ) / sizeof( void * );
+
 				std::vector<void *> ovtable;
-				for( void **vtable = target_vtable.pointer; ovtable.size( ) < ovtable.max_size( ) && *vtable != nullptr; ++vtable )
+				int32_t protections[64];
+				for( size_t offset = 0; offset < limit; )
 				{
-					if( !IsExecutableAddress( *vtable ) )
+					void **vtable = target_vtable.pointer + offset;
+					const size_t chunk = std::min<size_t>( limit - offset, 64 );
+
+					size_t count = 0;
+					for( ; count < chunk && vtable[count] != nullptr; ++count );
+
+					GetMemoryProtection( vtable, count, protections );
+
+					size_t valid = 0;
+					for( ; valid < count && ( protections[valid] & MemoryProtection::Execute ) != 0; ++valid );
+
+					ovtable.insert( ovtable.end( ), vtable, vtable + valid );
+					if( valid != chunk )
 						break;
 
-					ovtable.push_back( *vtable );
+					offset += chunk;
 				}
 
 				if( ovtable.empty( ) )
@@ -449,29 +706,299 @@ namespace Detouring
 				return true;
 			}
 
+			bool EnableShadowVTable( )
+			{
+
+#if defined COMPILER_VC
+
+				return false;
+
+#else
+
+				std::lock_guard lock( shadow_mutex );
+				if( shadow_vtable.load( std::memory_order_acquire ) != nullptr )
+					return true;
+
+				if( target_vtable.pointer == nullptr )
+					return false;
+
+				for( size_t index = 0; index < target_vtable.size; ++index )
+					if( target_vtable.pointer[index] != original_vtable[index] )
+						return false;
+
+				// Keep the offset to top and RTTI slots in front of the functions
+				// so dynamic_cast and typeid keep working on shadowed instances
+				const size_t size = ShadowVTablePrefix + target_vtable.size;
+				std::atomic<void *> *vtable = new std::atomic<void *>[size];
+				for( size_t index = 0; index < size; ++index )
+					vtable[index].store( nullptr, std::memory_order_relaxed );
+
+				MemoryRegion region;
+				if( GetMemoryRegion( target_vtable.pointer - ShadowVTablePrefix, region ) &&
+					( region.protection & MemoryProtection::Read ) != 0 )
+					for( size_t index = 0; index < ShadowVTablePrefix; ++index )
+						vtable[index].store(
+							( target_vtable.pointer - ShadowVTablePrefix )[index],
+							std::memory_order_relaxed
+						);
+
+				for( size_t index = 0; index < target_vtable.size; ++index )
+					vtable[ShadowVTablePrefix + index].store( original_vtable[index], std::memory_order_relaxed );
+
+				shadow_vtable.store( vtable, std::memory_order_release );
+				return true;
+
+#endif
+
+			}
+
+			bool HasHook( void *address )
+			{
+				std::shared_lock lock( hooks_mutex );
+				return hooks.find( address ) != hooks.end( );
+			}
+
+			void *GetTrampoline( void *address )
+			{
+				std::shared_lock lock( hooks_mutex );
+				const auto it = hooks.find( address );
+				return it != hooks.end( ) ? it->second->GetTrampoline( ) : nullptr;
+			}
+
+			// Takes the hook only if none is there yet
+			bool AddHook( void *address, std::unique_ptr<Detouring::Hook> &hook )
+			{
+				std::unique_lock lock( hooks_mutex );
+				if( hooks.find( address ) != hooks.end( ) )
+					return false;
+
+				hooks.emplace( address, std::move( hook ) );
+				return true;
+			}
+
+			// Destroyed by the caller, outside of the lock
+			std::unique_ptr<Detouring::Hook> TakeHook( void *address )
+			{
+				std::unique_lock lock( hooks_mutex );
+				const auto it = hooks.find( address );
+				if( it == hooks.end( ) )
+					return nullptr;
+
+				std::unique_ptr<Detouring::Hook> hook = std::move( it->second );
+				hooks.erase( it );
+				return hook;
+			}
+
+			// The table virtual method hooks are written to
+			void **GetHookedVTable( )
+			{
+				std::atomic<void *> *shadow = shadow_vtable.load( std::memory_order_acquire );
+				if( shadow == nullptr )
+					return target_vtable.pointer;
+
+				return reinterpret_cast<void **>( shadow + ShadowVTablePrefix );
+			}
+
+			void *GetHookedFunction( size_t index )
+			{
+				std::atomic<void *> *shadow = shadow_vtable.load( std::memory_order_acquire );
+				if( shadow == nullptr )
+					return target_vtable.pointer[index];
+
+				return shadow[ShadowVTablePrefix + index].load( std::memory_order_acquire );
+			}
+
+			void SetVirtualFunction( size_t index, void *function )
+			{
+				InvalidateSlots( );
+
+				// Shadowed instances call through these entries concurrently
+				std::atomic<void *> *shadow = shadow_vtable.load( std::memory_order_acquire );
+				if( shadow != nullptr )
+				{
+					shadow[ShadowVTablePrefix + index].store( function, std::memory_order_release );
+					return;
+				}
+
+				WriteProtectedMemory( target_vtable.pointer + index, &function, sizeof( void * ) );
+			}
+
+			void RegisterSlot( std::atomic<void *> &slot )
+			{
+				std::lock_guard lock( slots_mutex );
+				if( std::find( slots.begin( ), slots.end( ), &slot ) == slots.end( ) )
+					slots.push_back( &slot );
+			}
+
+			void InvalidateSlots( )
+			{
+				std::lock_guard lock( slots_mutex );
+				slot_generation.fetch_add( 1, std::memory_order_acq_rel );
+				for( std::atomic<void *> *slot : slots )
+					slot->store( nullptr, std::memory_order_release );
+			}
+
+			// Offset to top and RTTI pointer, in the Itanium C++ ABI
+			static constexpr size_t ShadowVTablePrefix = 2;
+
+			// The shadow table is handed to instances as a plain pointer table
+			static_assert(
+				sizeof( std::atomic<void *> ) == sizeof( void * ) && std::atomic<void *>::is_always_lock_free,
+				"atomic pointers must share the layout of plain ones"
+			);
+
 			VTable target_vtable;
 			std::vector<void *> original_vtable;
 			VTable substitute_vtable;
+
+			// Read by concurrent calls while Hook and UnHook change it
 			HookMap hooks;
+			std::shared_mutex hooks_mutex;
+
+			std::atomic<std::atomic<void *> *> shadow_vtable = nullptr;
+			std::vector<Target *> shadowed_instances;
+			std::mutex shadow_mutex;
+			std::vector<std::atomic<void *> *> slots;
+			std::atomic<uint64_t> slot_generation = 0;
+			std::mutex slots_mutex;
 		};
 
-		static std::shared_ptr<SharedState> GetSharedState( const bool create_if_needed = false )
+		// Readers announce themselves on one of several counters (picked per
+		// thread) before loading the published state, so they never lock.
+		// The last owner unpublishes the state and waits for the readers of
+		// both counter generations to leave before deleting it. Readers only
+		// hold a guard while resolving, never while calling an original.
+		struct alignas( 64 ) ReaderCounter
+		{
+			std::atomic<size_t> count = 0;
+		};
+
+		static constexpr size_t ReaderStripes = 16;
+
+		struct SharedStateReaders
+		{
+			std::atomic<SharedState *> published = nullptr;
+			std::atomic<size_t> generation = 0;
+			ReaderCounter counters[2][ReaderStripes];
+
+			// Serializes the generation flips of concurrent destructions
+			std::mutex reclaim_mutex;
+		};
+
+		static SharedStateReaders &GetSharedStateReaders( )
+		{
+			static SharedStateReaders readers;
+			return readers;
+		}
+
+		static size_t GetReaderStripe( )
+		{
+			static std::atomic<size_t> next_stripe = 0;
+			static thread_local const size_t stripe = next_stripe.fetch_add( 1, std::memory_order_relaxed ) % ReaderStripes;
+			return stripe;
+		}
+
+		class SharedStateGuard
+		{
+		public:
+			SharedStateGuard( )
+			{
+				SharedStateReaders &readers = GetSharedStateReaders( );
+				const size_t generation = readers.generation.load( std::memory_order_seq_cst ) & 1;
+				counter = &readers.counters[generation][GetReaderStripe( )].count;
+				counter->fetch_add( 1, std::memory_order_seq_cst );
+				shared_state = readers.published.load( std::memory_order_seq_cst );
+			}
+
+			SharedStateGuard( const SharedStateGuard & ) = delete;
+			SharedStateGuard( SharedStateGuard && ) = delete;
+
+			~SharedStateGuard( )
+			{
+				counter->fetch_sub( 1, std::memory_order_release );
+			}
+
+			SharedStateGuard &operator=( const SharedStateGuard & ) = delete;
+			SharedStateGuard &operator=( SharedStateGuard && ) = delete;
+
+			explicit operator bool( ) const
+			{
+				return shared_state != nullptr;
+			}
+
+			SharedState *operator->( ) const
+			{
+				return shared_state;
+			}
+
+			SharedState &operator*( ) const
+			{
+				return *shared_state;
+			}
+
+		private:
+			std::atomic<size_t> *counter = nullptr;
+			SharedState *shared_state = nullptr;
+		};
+
+		static SharedStateGuard GetSharedState( )
+		{
+			return SharedStateGuard( );
+		}
+
+		static std::mutex &GetSharedStateMutex( )
 		{
-			static std::weak_ptr<SharedState> weak_shared_state;
 			static std::mutex shared_state_mutex;
+			return shared_state_mutex;
+		}
+
+		static void DestroySharedState( SharedState *shared_state )
+		{
+			SharedStateReaders &readers = GetSharedStateReaders( );
+
+			{
+				std::lock_guard lock( GetSharedStateMutex( ) );
+
+				// A new state may have been published already
+				SharedState *expected = shared_state;
+				readers.published.compare_exchange_strong( expected, nullptr, std::memory_order_seq_cst );
+			}
+
+			// Waits without the shared state mutex, so a new state can be
+			// created meanwhile
+			{
+				std::lock_guard lock( readers.reclaim_mutex );
 
-			std::lock_guard lock( shared_state_mutex );
+				// Flip twice so readers that picked either generation have left
+				for( int round = 0; round < 2; ++round )
+				{
+					const size_t generation = readers.generation.fetch_add( 1, std::memory_order_seq_cst ) & 1;
+					for( const ReaderCounter &counter : readers.counters[generation] )
+						while( counter.count.load( std::memory_order_seq_cst ) != 0 )
+							std::this_thread::yield( );
+				}
+			}
+
+			delete shared_state;
+		}
+
+		static std::shared_ptr<SharedState> CreateSharedState( )
+		{
+			static std::weak_ptr<SharedState> weak_shared_state;
+
+			std::lock_guard lock( GetSharedStateMutex( ) );
 
 			auto shared_state = weak_shared_state.lock( );
-			if( !shared_state && create_if_needed )
+			if( !shared_state )
 			{
-				shared_state = std::make_shared<SharedState>( );
+				shared_state = std::shared_ptr<SharedState>( new SharedState( ), DestroySharedState );
 				weak_shared_state = shared_state;
+				GetSharedStateReaders( ).published.store( shared_state.get( ), std::memory_order_seq_cst );
 			}
 
 			return shared_state;
 		}
 
-		const std::shared_ptr<SharedState> state = GetSharedState( true );
+		const std::shared_ptr<SharedState> state = CreateSharedState( );
 	};
 }
@@ -91,6 +91,7 @@
 #include "MinHook.h"
 #include "platform.hpp"
 #include "hook.hpp"
+#include "importhook.hpp"
 
 #ifdef SYSTEM_POSIX
 
@@ -572,7 +573,7 @@ namespace MologieDetours
 	*
 	* @brief Used for creating detours on an import of a single module.
 	*
-	* @deprecated This class is a dummy.
+	* @deprecated Please port all code that uses this header to the new one.
 	*/
 	template<typename function_type>
 	class DetourImport
@@ -583,25 +584,96 @@ namespace MologieDetours
 		*
 		* @brief Creates a new local detour using a given import.
 		*
-		* @deprecated This function is a dummy.
+		* @param pSource The address of the import slot (IAT entry or GOT slot).
+		* @param pDetour The detour function.
+		*
+		* @exception DetourPageProtectionException Thrown when the import slot can not be written.
+		*
+		* @deprecated Please port all code that uses this header to the new one.
 		*/
-		DEPRECATED_WITH_SUBSTITUTE( Detouring::Hook )
-		DetourImport( uintptr_t, function_type )
-		{ }
+		DEPRECATED_WITH_SUBSTITUTE( Detouring::ImportHook )
+		DetourImport( address_type pSource, function_type pDetour ) :
+			source( reinterpret_cast<void **>( pSource ) )
+		{
+			if( !hook.Create( source, reinterpret_cast<void *>( pDetour ) ) )
+				throw DetourPageProtectionException( "Failed to write the import slot", source );
+		}
+
+		/**
+		* @fn DetourImport::~DetourImport( )
+		*
+		* @brief Destroys the detour, restoring the import slot.
+		*
+		* @deprecated Please port all code that uses this header to the new one.
+		*/
+		DEPRECATED_WITH_SUBSTITUTE( Detouring::ImportHook )
+		~DetourImport( )
+		{
+			hook.Destroy( );
+		}
 
 		/**
 		* @fn bool DetourImport::IsValid( )
 		*
 		* @brief Query if the detour is still applied.
 		*
-		* @return Always returns false.
+		* @return Returns true if the import slot still points to the detour.
 		*
-		* @deprecated This function is a dummy.
+		* @deprecated Please port all code that uses this header to the new one.
 		*/
-		DEPRECATED_WITH_SUBSTITUTE( Detouring::Hook )
+		DEPRECATED_WITH_SUBSTITUTE( Detouring::ImportHook )
 		bool IsValid( )
 		{
-			return false;
+			return hook.IsValid( ) && *source == hook.GetDetour( );
+		}
+
+		/**
+		* @fn address_type DetourImport::GetSource( )
+		*
+		* @brief Gets the source.
+		*
+		* @return Returns the address of the detoured import slot.
+		*
+		* @deprecated Please port all code that uses this header to the new one.
+		*/
+		DEPRECATED_WITH_SUBSTITUTE( Detouring::ImportHook )
+		address_type GetSource( )
+		{
+			return reinterpret_cast<address_type>( source );
+		}
+
+		/**
+		* @fn function_type DetourImport::GetDetour( )
+		*
+		* @brief Gets the detour.
+		*
+		* @return Returns the address of the detour.
+		*
+		* @deprecated Please port all code that uses this header to the new one.
+		*/
+		DEPRECATED_WITH_SUBSTITUTE( Detouring::ImportHook )
+		function_type GetDetour( )
+		{
+			return hook.GetDetour<function_type>( );
 		}
+
+		/**
+		* @fn function_type DetourImport::GetOriginalFunction( )
+		*
+		* @brief Gets the original function.
+		*
+		* @return Returns the address the import slot held before being detoured.
+		*
+		* @deprecated Please port all code that uses this header to the new one.
+		*/
+		DEPRECATED_WITH_SUBSTITUTE( Detouring::ImportHook )
+		function_type GetOriginalFunction( )
+		{
+			return hook.GetOriginal<function_type>( );
+		}
+
+	private:
+		void **source; // Pointer to the import slot
+		Detouring::ImportHook hook; // Rewrites the import slot
 	};
 }
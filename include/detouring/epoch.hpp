@@ -0,0 +1,68 @@
+/*************************************************************************
+* Detouring::EpochGuard
+* Epoch based reclamation for the trampolines and gates of destroyed
+* hooks.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+
+namespace Detouring
+{
+	// Destroying a hook restores its target right away, but its trampoline
+	// and gate are only released once every guard that was held at the time
+	// has been released. Entering and leaving only touch a per-thread record.
+	//
+	// Only guarded threads are protected: threads running through a hook are
+	// not tracked otherwise. A detour that calls the trampoline without
+	// holding a guard, or before building it, may run freed code if the hook
+	// is destroyed meanwhile, just like without guards. ClassProxy::Call
+	// holds one while resolving and calling the original; other detours
+	// must enter one themselves, as early as they can.
+	class EpochGuard
+	{
+	public:
+		EpochGuard( );
+		EpochGuard( const EpochGuard & ) = delete;
+
+		~EpochGuard( );
+
+		EpochGuard &operator=( const EpochGuard & ) = delete;
+	};
+
+	// Releases what destroyed hooks left behind and no guard can still be
+	// using. Waiting is skipped when the calling thread holds a guard.
+	// Returns the number of hooks still waiting to be released.
+	size_t ReclaimDestroyedHooks( bool wait = false );
+}
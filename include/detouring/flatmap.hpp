@@ -0,0 +1,490 @@
+/*************************************************************************
+* Detouring::FlatMap
+* A C++ open addressing hash table keyed by pointers, probing groups of
+* 16 control bytes at a time.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "platform.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <utility>
+#include <tuple>
+#include <iterator>
+#include <type_traits>
+
+#if defined ARCHITECTURE_X86_64 || defined __SSE2__ || ( defined _M_IX86_FP && _M_IX86_FP >= 2 )
+
+#define DETOURING_FLATMAP_SSE2 1
+
+#include <emmintrin.h>
+
+#endif
+
+#if defined COMPILER_VC
+
+#include <intrin.h>
+
+#endif
+
+namespace Detouring
+{
+	// Entries live in a flat array next to one control byte each, which holds
+	// 7 bits of the hash of a full slot or marks it as empty or deleted.
+	// Lookups compare a whole group of control bytes at once and only touch
+	// the entries whose hash bits match. Entries move when the table grows.
+	template<typename Value>
+	class FlatMap
+	{
+	public:
+		typedef void *key_type;
+		typedef Value mapped_type;
+		typedef std::pair<void *, Value> value_type;
+		typedef size_t size_type;
+
+		template<bool IsConst>
+		class Iterator
+		{
+		public:
+			typedef std::forward_iterator_tag iterator_category;
+			typedef std::conditional_t<IsConst, const std::pair<void *, Value>, std::pair<void *, Value>> value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef value_type *pointer;
+			typedef value_type &reference;
+
+			Iterator( ) = default;
+
+			template<bool OtherIsConst, std::enable_if_t<IsConst && !OtherIsConst, int> = 0>
+			Iterator( const Iterator<OtherIsConst> &other ) :
+				map( other.map ),
+				index( other.index )
+			{ }
+
+			reference operator*( ) const
+			{
+				return map->slots[index];
+			}
+
+			pointer operator->( ) const
+			{
+				return &map->slots[index];
+			}
+
+			Iterator &operator++( )
+			{
+				index = map->NextFull( index + 1 );
+				return *this;
+			}
+
+			Iterator operator++( int )
+			{
+				Iterator previous = *this;
+				++*this;
+				return previous;
+			}
+
+			bool operator==( const Iterator &other ) const
+			{
+				return index == other.index;
+			}
+
+			bool operator!=( const Iterator &other ) const
+			{
+				return index != other.index;
+			}
+
+		private:
+			friend class FlatMap;
+
+			template<bool>
+			friend class Iterator;
+
+			typedef std::conditional_t<IsConst, const FlatMap, FlatMap> MapType;
+
+			Iterator( MapType *owner, size_t position ) :
+				map( owner ),
+				index( position )
+			{ }
+
+			MapType *map = nullptr;
+			size_t index = 0;
+		};
+
+		typedef Iterator<false> iterator;
+		typedef Iterator<true> const_iterator;
+
+		FlatMap( ) = default;
+
+		FlatMap( const FlatMap & ) = delete;
+
+		FlatMap( FlatMap &&other ) noexcept
+		{
+			Swap( other );
+		}
+
+		~FlatMap( )
+		{
+			Release( );
+		}
+
+		FlatMap &operator=( const FlatMap & ) = delete;
+
+		FlatMap &operator=( FlatMap &&other ) noexcept
+		{
+			if( this != &other )
+			{
+				Release( );
+				Swap( other );
+			}
+
+			return *this;
+		}
+
+		iterator begin( )
+		{
+			return iterator( this, NextFull( 0 ) );
+		}
+
+		iterator end( )
+		{
+			return iterator( this, capacity );
+		}
+
+		const_iterator begin( ) const
+		{
+			return const_iterator( this, NextFull( 0 ) );
+		}
+
+		const_iterator end( ) const
+		{
+			return const_iterator( this, capacity );
+		}
+
+		bool empty( ) const
+		{
+			return size_ == 0;
+		}
+
+		size_t size( ) const
+		{
+			return size_;
+		}
+
+		iterator find( const void *key )
+		{
+			return iterator( this, Find( key ) );
+		}
+
+		const_iterator find( const void *key ) const
+		{
+			return const_iterator( this, Find( key ) );
+		}
+
+		size_t count( const void *key ) const
+		{
+			return Find( key ) != capacity ? 1 : 0;
+		}
+
+		Value &operator[]( void *key )
+		{
+			return emplace( key ).first->second;
+		}
+
+		template<typename... Args>
+		std::pair<iterator, bool> emplace( void *key, Args &&... args )
+		{
+			const size_t found = Find( key );
+			if( found != capacity )
+				return { iterator( this, found ), false };
+
+			if( ( size_ + deleted + 1 ) * 8 > capacity * 7 )
+				Rehash( ( size_ + 1 ) * 8 > capacity * 4 ? capacity * 2 : capacity );
+
+			const size_t hash = Hash( key );
+			const size_t index = FindInsertSlot( hash );
+			if( controls[index] == Deleted )
+				--deleted;
+
+			new( &slots[index] ) value_type( std::piecewise_construct,
+				std::forward_as_tuple( key ), std::forward_as_tuple( std::forward<Args>( args )... ) );
+			controls[index] = static_cast<int8_t>( hash & 0x7F );
+			++size_;
+			return { iterator( this, index ), true };
+		}
+
+		iterator erase( iterator it )
+		{
+			EraseAt( it.index );
+			return iterator( this, NextFull( it.index + 1 ) );
+		}
+
+		size_t erase( const void *key )
+		{
+			const size_t index = Find( key );
+			if( index == capacity )
+				return 0;
+
+			EraseAt( index );
+			return 1;
+		}
+
+		void clear( )
+		{
+			if( capacity == 0 )
+				return;
+
+			for( size_t index = 0; index < capacity; ++index )
+				if( controls[index] >= 0 )
+					slots[index].~value_type( );
+
+			std::memset( controls.get( ), Empty, capacity );
+			size_ = 0;
+			deleted = 0;
+		}
+
+		void reserve( size_t count )
+		{
+			size_t target = GroupSize;
+			while( target * 7 < count * 8 )
+				target *= 2;
+
+			if( target > capacity )
+				Rehash( target );
+		}
+
+	private:
+		static constexpr size_t GroupSize = 16;
+		static constexpr int8_t Empty = -128;
+		static constexpr int8_t Deleted = -2;
+
+		static size_t Hash( const void *key )
+		{
+			uint64_t value = static_cast<uint64_t>( reinterpret_cast<uintptr_t>( key ) );
+			value ^= value >> 33;
+			value *= 0xFF51AFD7ED558CCD;
+			value ^= value >> 33;
+			return static_cast<size_t>( value );
+		}
+
+		// Bit k is set when control byte k of the group equals the value
+		static uint32_t MatchGroup( const int8_t *group, int8_t value )
+		{
+
+#if defined DETOURING_FLATMAP_SSE2
+
+			const __m128i controls_group = _mm_loadu_si128( reinterpret_cast<const __m128i *>( group ) );
+			return static_cast<uint32_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( controls_group, _mm_set1_epi8( value ) ) ) );
+
+#else
+
+			uint32_t mask = 0;
+			for( size_t k = 0; k < GroupSize; ++k )
+				if( group[k] == value )
+					mask |= 1u << k;
+
+			return mask;
+
+#endif
+
+		}
+
+		// Bit k is set when slot k of the group is empty or deleted
+		static uint32_t MatchFree( const int8_t *group )
+		{
+
+#if defined DETOURING_FLATMAP_SSE2
+
+			const __m128i controls_group = _mm_loadu_si128( reinterpret_cast<const __m128i *>( group ) );
+			return static_cast<uint32_t>( _mm_movemask_epi8( controls_group ) );
+
+#else
+
+			uint32_t mask = 0;
+			for( size_t k = 0; k < GroupSize; ++k )
+				if( group[k] < 0 )
+					mask |= 1u << k;
+
+			return mask;
+
+#endif
+
+		}
+
+		static size_t LowestBit( uint32_t mask )
+		{
+
+#if defined COMPILER_VC
+
+			unsigned long bit = 0;
+			_BitScanForward( &bit, mask );
+			return bit;
+
+#else
+
+			return static_cast<size_t>( __builtin_ctz( mask ) );
+
+#endif
+
+		}
+
+		size_t Find( const void *key ) const
+		{
+			if( size_ == 0 )
+				return capacity;
+
+			const size_t hash = Hash( key );
+			const int8_t tag = static_cast<int8_t>( hash & 0x7F );
+			const size_t group_mask = capacity / GroupSize - 1;
+			size_t group = ( hash >> 7 ) & group_mask;
+			for( size_t step = 1; step <= group_mask + 1; ++step )
+			{
+				const int8_t *group_controls = controls.get( ) + group * GroupSize;
+				for( uint32_t match = MatchGroup( group_controls, tag ); match != 0; match &= match - 1 )
+				{
+					const size_t index = group * GroupSize + LowestBit( match );
+					if( slots[index].first == key )
+						return index;
+				}
+
+				if( MatchGroup( group_controls, Empty ) != 0 )
+					return capacity;
+
+				group = ( group + step ) & group_mask;
+			}
+
+			return capacity;
+		}
+
+		size_t FindInsertSlot( size_t hash ) const
+		{
+			const size_t group_mask = capacity / GroupSize - 1;
+			size_t group = ( hash >> 7 ) & group_mask;
+			for( size_t step = 1; ; ++step )
+			{
+				const uint32_t free = MatchFree( controls.get( ) + group * GroupSize );
+				if( free != 0 )
+					return group * GroupSize + LowestBit( free );
+
+				group = ( group + step ) & group_mask;
+			}
+		}
+
+		size_t NextFull( size_t index ) const
+		{
+			for( ; index < capacity && controls[index] < 0; ++index );
+			return index;
+		}
+
+		void EraseAt( size_t index )
+		{
+			slots[index].~value_type( );
+			--size_;
+
+			// A group that still has an empty slot never made a probe move on,
+			// so nothing depends on this slot staying occupied
+			const int8_t *group_controls = controls.get( ) + index / GroupSize * GroupSize;
+			if( MatchGroup( group_controls, Empty ) != 0 )
+			{
+				controls[index] = Empty;
+			}
+			else
+			{
+				controls[index] = Deleted;
+				++deleted;
+			}
+		}
+
+		void Rehash( size_t new_capacity )
+		{
+			if( new_capacity < GroupSize )
+				new_capacity = GroupSize;
+
+			std::unique_ptr<int8_t[]> old_controls = std::move( controls );
+			value_type *old_slots = slots;
+			const size_t old_capacity = capacity;
+
+			controls.reset( new int8_t[new_capacity] );
+			std::memset( controls.get( ), Empty, new_capacity );
+			slots = std::allocator<value_type>( ).allocate( new_capacity );
+			capacity = new_capacity;
+			deleted = 0;
+
+			for( size_t index = 0; index < old_capacity; ++index )
+			{
+				if( old_controls[index] < 0 )
+					continue;
+
+				const size_t hash = Hash( old_slots[index].first );
+				const size_t target = FindInsertSlot( hash );
+				new( &slots[target] ) value_type( std::move( old_slots[index] ) );
+				controls[target] = static_cast<int8_t>( hash & 0x7F );
+				old_slots[index].~value_type( );
+			}
+
+			if( old_slots != nullptr )
+				std::allocator<value_type>( ).deallocate( old_slots, old_capacity );
+		}
+
+		void Release( )
+		{
+			if( slots == nullptr )
+				return;
+
+			clear( );
+			std::allocator<value_type>( ).deallocate( slots, capacity );
+			slots = nullptr;
+			controls.reset( );
+			capacity = 0;
+		}
+
+		void Swap( FlatMap &other )
+		{
+			std::swap( controls, other.controls );
+			std::swap( slots, other.slots );
+			std::swap( capacity, other.capacity );
+			std::swap( size_, other.size_ );
+			std::swap( deleted, other.deleted );
+		}
+
+		std::unique_ptr<int8_t[]> controls;
+		value_type *slots = nullptr;
+		size_t capacity = 0;
+		size_t size_ = 0;
+		size_t deleted = 0;
+	};
+}
@@ -46,6 +46,7 @@
 #include <cstddef>
 #include <type_traits>
 #include <tuple>
+#include <vector>
 
 #include "platform.hpp"
 
@@ -75,12 +76,78 @@ namespace Detouring
 		size_t index;
 	};
 
+	struct MemoryRegion
+	{
+		uintptr_t start;
+		uintptr_t end;
+		int32_t protection;
+	};
+
+	bool GetMemoryRegion( void *address, MemoryRegion &region );
+
 	int32_t GetMemoryProtection( void *address );
 
+	// Classifies many addresses in a single sweep over the memory map
+	// Returns false if any of the addresses is not mapped
+	bool GetMemoryProtection( void *const *addresses, size_t count, int32_t *protections );
+
 	bool SetMemoryProtection( void *address, size_t length, int32_t protection );
 
+	size_t GetPageSize( );
+
 	bool ProtectMemory( void *address, size_t length, bool protect );
 
+	// Makes the pages of every added range writable until destroyed, when
+	// each page gets back the exact protection it had, instead of the
+	// Read | Execute ProtectMemory always restores. Ranges added before an
+	// Apply are merged when their pages overlap or touch, so each run of
+	// pages sharing a protection takes a single SetMemoryProtection call.
+	class WritableScope
+	{
+	public:
+		WritableScope( ) = default;
+		WritableScope( void *address, size_t length );
+		WritableScope( const WritableScope & ) = delete;
+		WritableScope &operator=( const WritableScope & ) = delete;
+		~WritableScope( );
+
+		void Add( void *address, size_t length );
+
+		// Returns false if any page could not be made writable, in which case
+		// the others still are until Restore. Reads the current memory map
+		// first, since the protection of the pages is restored from it.
+		bool Apply( );
+		void Restore( );
+
+	private:
+		struct Range
+		{
+			uintptr_t start;
+			uintptr_t end;
+			int32_t protection;
+		};
+
+		std::vector<Range> pending;
+		std::vector<Range> changed;
+	};
+
+	// Writes over memory without changing its protection. On Linux this is a
+	// write to /proc/self/mem, which skips the two mprotect calls and the
+	// window where the pages are writable. Elsewhere, or when that fails, the
+	// memory is made writable with a WritableScope for the write. A single
+	// aligned pointer is written in one store either way, so threads calling
+	// through it never see it half written.
+	bool WriteProtectedMemory( void *address, const void *data, size_t length );
+
+	// Protection queries on Linux are answered from a cached copy of the
+	// process memory map, without system calls for addresses found in it.
+	// It is rebuilt when a mapped address is missing from it, when a batch
+	// query finds modules were loaded or unloaded and before WritableScope
+	// changes protections. Call this after reprotecting or unmapping memory
+	// through other means, or before trusting a single address query made
+	// right after a module was unloaded.
+	bool RefreshMemoryMap( );
+
 	bool IsExecutableAddress( void *address );
 
 	template<typename Class>
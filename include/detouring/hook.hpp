@@ -36,6 +36,7 @@
 #pragma once
 
 #include <string>
+#include <atomic>
 
 namespace Detouring
 {
@@ -80,8 +81,8 @@ namespace Detouring
 		};
 
 		Hook( ) = default;
-		Hook( const Target &target, void *detour );
-		Hook( const Module &module, const std::string &target, void *detour );
+		Hook( const Target &target, void *detour, bool soft = false );
+		Hook( const Module &module, const std::string &target, void *detour, bool soft = false );
 
 		Hook( const Hook & ) = delete;
 		Hook( Hook && ) = delete;
@@ -93,10 +94,34 @@ namespace Detouring
 
 		bool IsValid( ) const;
 
-		bool Create( const Target &target, void *detour );
-		bool Create( const Module &module, const std::string &target, void *detour );
+		// Soft hooks patch the target once, jumping to a gate that holds either
+		// the detour or the trampoline, so Enable and Disable are a single
+		// atomic store. Soft hooks are created patched but disabled.
+		bool Create( const Target &target, void *detour, bool soft = false );
+		bool Create( const Module &module, const std::string &target, void *detour, bool soft = false );
+		// Waits for the module to be loaded (noticed through WatchDlopen, which
+		// the first deferred hook installs on Linux) to create and enable the
+		// hook, batched with the other hooks on it. Hooks on modules that are
+		// already loaded are created right away and hooks that fail to be
+		// created are dropped, leaving IsValid false.
+		bool CreateDeferred( const Module &module, const std::string &target, void *detour );
+		bool IsDeferred( ) const;
+		// Applies the deferred hooks of modules loaded through other means,
+		// which is the only way they are noticed on Windows and macOS
+		static void CheckDeferred( );
+		// Linux only: notices loads as they happen by routing the dlopen import
+		// of every module through a wrapper. Those modules resolve RPATH,
+		// RUNPATH and $ORIGIN against this library instead of the caller.
+		// Installed by the first deferred hook, otherwise only by this call.
+		static void WatchDlopen( );
+
+		// The target is restored right away, while the trampoline is only
+		// released once no EpochGuard entered before this call is held.
+		// Threads using the trampoline without a guard get no protection.
 		bool Destroy( );
 
+		bool IsSoft( ) const;
+
 		bool IsEnabled( ) const;
 		bool Enable( );
 		bool Disable( );
@@ -117,6 +142,16 @@ namespace Detouring
 			return reinterpret_cast<Method>( GetDetour( ) );
 		}
 
+		// Replaces the detour of a soft hook with a single atomic store in its
+		// gate, so calls never reach the target unhooked in the meantime
+		bool SetDetour( void *detour );
+
+		template<typename Method>
+		bool SetDetour( Method detour )
+		{
+			return SetDetour( reinterpret_cast<void *>( detour ) );
+		}
+
 		void *GetTrampoline( ) const;
 
 		template<typename Method>
@@ -129,8 +164,13 @@ namespace Detouring
 		void *FindSymbol( const std::string &symbol );
 		void *FindSymbol( void *module, const std::string &symbol );
 
+		bool FinishCreate( );
+		void ReleaseGate( );
+
 		void *target = nullptr;
 		void *detour = nullptr;
 		void *trampoline = nullptr;
+		void *gate_code = nullptr;
+		std::atomic<void *> *gate_slot = nullptr;
 	};
 }
@@ -0,0 +1,120 @@
+/*************************************************************************
+* Detouring::ImportHook
+* A C++ class that detours the imports of a single module by rewriting
+* its GOT slots.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Detouring
+{
+	struct DynamicInfo;
+
+	// Only calls made by the hooked module through its imports reach the
+	// detour. No code is patched, so there is no trampoline: the original
+	// is the address the slots held (or would have been bound to).
+	class ImportHook
+	{
+	public:
+		ImportHook( ) = default;
+		ImportHook( const Hook::Module &module, const std::string &import, void *detour );
+		ImportHook( void **slot, void *detour );
+		ImportHook( const std::string &import, void *detour );
+
+		ImportHook( const ImportHook & ) = delete;
+		ImportHook( ImportHook && ) = delete;
+
+		~ImportHook( );
+
+		ImportHook &operator=( const ImportHook & ) = delete;
+		ImportHook &operator=( ImportHook && ) = delete;
+
+		bool IsValid( ) const;
+
+		// Finds the slots through the module's JUMP_SLOT and GLOB_DAT
+		// relocations, which is only supported on Linux
+		bool Create( const Hook::Module &module, const std::string &import, void *detour );
+		// The slot may be any import slot, like an IAT entry on Windows
+		bool Create( void **slot, void *detour );
+		// Hooks the import of every loaded module, except the one holding the
+		// detour, and of every module loaded afterwards once it is noticed.
+		// The original is the default definition. Only supported on Linux.
+		bool Create( const std::string &import, void *detour );
+		// Slots that were rewritten by someone else since are left alone
+		bool Destroy( );
+
+		bool IsGlobal( ) const;
+
+		// Applies global hooks to modules loaded since the last hook was
+		// created, unless Hook::WatchDlopen already noticed them
+		static void CheckLoadedModules( );
+
+		const std::vector<void **> &GetSlots( ) const;
+
+		void *GetDetour( ) const;
+
+		template<typename Method>
+		Method GetDetour( ) const
+		{
+			return reinterpret_cast<Method>( GetDetour( ) );
+		}
+
+		void *GetOriginal( ) const;
+
+		template<typename Method>
+		Method GetOriginal( ) const
+		{
+			return reinterpret_cast<Method>( GetOriginal( ) );
+		}
+
+	private:
+		friend void ApplyGlobalImports( const DynamicInfo &module );
+
+		// Points the new slots to the detour, remembering what they held
+		bool Attach( const std::vector<void **> &found );
+
+		std::vector<void **> slots;
+		std::vector<void *> previous;
+		void *detour = nullptr;
+		void *original = nullptr;
+		std::string import;
+		bool global = false;
+		uintptr_t excluded_base = UINTPTR_MAX;
+	};
+}
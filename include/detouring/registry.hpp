@@ -0,0 +1,93 @@
+/*************************************************************************
+* Detouring::HookRegistry
+* A C++ class that indexes every Detouring::Hook in the process by its
+* target, detour and trampoline addresses.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace Detouring
+{
+	// Hooks register themselves when created and unregister when destroyed.
+	// The registry also tracks whether each hook is enabled, which is what
+	// Hook::IsEnabled reports instead of asking MinHook.
+	class HookRegistry
+	{
+	public:
+		struct Entry
+		{
+			Hook *hook;
+			void *target;
+			void *detour;
+			void *trampoline;
+			bool enabled;
+		};
+
+		// Matches the address against targets, then trampolines, then detours
+		static bool Find( const void *address, Entry &entry );
+
+		static bool FindByTarget( const void *target, Entry &entry );
+		static bool FindByTrampoline( const void *trampoline, Entry &entry );
+
+		// A detour may be shared by many hooks, in which case the first one
+		// registered is returned
+		static bool FindByDetour( const void *detour, Entry &entry );
+
+		static bool IsHooked( const void *target );
+		static size_t GetSize( );
+
+		// The registry stays locked while the callback runs, so it must not
+		// create, destroy, enable or disable hooks
+		static void ForEach( const std::function<void( const Entry & )> &callback );
+
+		static std::vector<Entry> GetEntries( );
+
+	private:
+		friend class Hook;
+		friend class HookTransaction;
+
+		static void Register( Hook &hook );
+		static void Unregister( const Hook &hook );
+
+		static void SetDetour( const Hook &hook, void *previous );
+
+		static bool IsEnabled( const void *target );
+		static void SetEnabled( const void *target, bool enabled );
+	};
+}
@@ -0,0 +1,101 @@
+/*************************************************************************
+* Detouring::Resolver
+* A C++ class that resolves symbols and signatures of many modules in
+* parallel.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+#include "signature.hpp"
+#include "cache.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Detouring
+{
+	// Collects symbol and signature requests, then resolves them on a bounded
+	// pool of worker threads. Work is split per module for symbols and per
+	// chunk of executable segment for signatures.
+	class Resolver
+	{
+	public:
+		// Zero threads uses the number of hardware threads
+		Resolver( size_t threads = 0 );
+
+		// Returns the identifier of the request, used to retrieve its address
+		size_t AddSymbol( const Hook::Module &module, const std::string &name );
+		size_t AddSignature( const Hook::Module &module, const Signature &signature );
+
+		size_t GetSize( ) const;
+		size_t GetThreadCount( ) const;
+
+		// Requests found in the cache are not resolved again and new results
+		// are added to it. The cache must outlive its use by the resolver.
+		void SetCache( ResolutionCache *resolution_cache );
+
+		// Resolves every request added since the last call.
+		// Returns true if all of those were resolved, whatever became of
+		// the requests of earlier calls.
+		bool Resolve( );
+
+		void *GetAddress( size_t id ) const;
+
+		template<typename Type>
+		Type GetAddress( size_t id ) const
+		{
+			return reinterpret_cast<Type>( GetAddress( id ) );
+		}
+
+		// Bytes of executable segment scanned by each signature task
+		static constexpr size_t ChunkSize = 1024 * 1024;
+
+	private:
+		struct Request
+		{
+			Hook::Module module;
+			std::string symbol;
+			Signature signature;
+			bool is_signature;
+		};
+
+		size_t thread_count;
+		ResolutionCache *cache = nullptr;
+		size_t resolved = 0;
+		std::vector<Request> requests;
+		std::vector<void *> addresses;
+	};
+}
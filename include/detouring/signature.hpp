@@ -0,0 +1,142 @@
+/*************************************************************************
+* Detouring::Signature
+* A C++ class that searches module code for byte patterns with
+* wildcards.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Detouring
+{
+	class Signature
+	{
+	public:
+		Signature( ) = default;
+
+		// Pattern of hexadecimal bytes where "??" or "?" is a wildcard,
+		// for example "48 8B ?? ?? E8"
+		Signature( const char *pattern );
+		Signature( const std::string &pattern );
+
+		// Raw bytes with a mask where 'x' must match and '?' is a wildcard,
+		// for example "\x48\x8B\x00\x00\xE8" and "xx??x"
+		Signature( const char *bytes, const char *mask );
+
+		bool IsValid( ) const;
+		size_t GetSize( ) const;
+
+		const std::vector<uint8_t> &GetBytes( ) const;
+
+		// 0xFF for bytes that must match, 0x00 for wildcards
+		const std::vector<uint8_t> &GetMask( ) const;
+
+		// Offset and value of the rarest concrete byte, used to filter candidates
+		size_t GetAnchorOffset( ) const;
+		uint8_t GetAnchor( ) const;
+
+		bool Matches( const uint8_t *address ) const;
+
+		// Searches [begin, end) and returns the first match or nullptr
+		const uint8_t *Find( const uint8_t *begin, const uint8_t *end ) const;
+
+	private:
+		void Prepare( );
+
+		std::vector<uint8_t> bytes;
+		std::vector<uint8_t> mask;
+		size_t anchor_offset = 0;
+		size_t second_anchor_offset = 0;
+	};
+
+	// Searches for many signatures in a single pass, bucketing them by a pair
+	// of consecutive concrete bytes (or a single byte when they have none)
+	class SignatureSet
+	{
+	public:
+		// Returns the identifier of the signature, which indexes the results
+		size_t Add( const Signature &signature );
+
+		size_t GetSize( ) const;
+		const Signature &Get( size_t id ) const;
+
+		// Must be called after adding signatures and before scanning ranges
+		void Compile( );
+
+		// Looks for the first match of every signature not found yet in
+		// results (which is resized to the number of signatures), checking
+		// candidates anchored in [from, to) that fit entirely in [begin, end).
+		// Returns the number of signatures found by this call.
+		size_t Scan(
+			const uint8_t *begin,
+			const uint8_t *end,
+			const uint8_t *from,
+			const uint8_t *to,
+			std::vector<void *> &results
+		) const;
+
+		size_t Scan( const uint8_t *begin, const uint8_t *end, std::vector<void *> &results ) const;
+
+		// Scans the executable segments of the module, compiling if needed
+		std::vector<void *> Scan( const Hook::Module &module );
+
+	private:
+		struct Entry
+		{
+			uint32_t id;
+			uint32_t offset;
+		};
+
+		std::vector<Signature> signatures;
+		bool compiled = false;
+
+		std::vector<uint64_t> pair_filter;
+		std::vector<uint32_t> pair_buckets;
+		std::vector<Entry> pair_entries;
+		std::vector<uint32_t> single_buckets;
+		std::vector<Entry> single_entries;
+	};
+
+	// Rates how often a byte shows up in x86 code, lower being rarer
+	uint8_t GetByteFrequency( uint8_t byte );
+
+	// Searches the executable segments of the module
+	void *FindSignature( const Hook::Module &module, const Signature &signature );
+	std::vector<void *> FindSignatureMatches( const Hook::Module &module, const Signature &signature );
+}
@@ -0,0 +1,122 @@
+/*************************************************************************
+* Detouring::SymbolIndex
+* A C++ class that indexes every named symbol of a module, including
+* the ones that are not exported.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+namespace Detouring
+{
+	// Reads .symtab and .dynsym from the module's file on disk (and from its
+	// .gnu_debuglink companion, if one is found) into a hash table.
+	// Only ELF modules are supported.
+	class SymbolIndex
+	{
+	public:
+		SymbolIndex( ) = default;
+		SymbolIndex( const Hook::Module &module );
+
+		bool Build( const Hook::Module &module );
+
+		bool IsValid( ) const;
+		size_t GetSize( ) const;
+		const std::string &GetPath( ) const;
+		std::chrono::nanoseconds GetBuildTime( ) const;
+
+		void *Find( const std::string &name ) const;
+
+		template<typename Type>
+		Type Find( const std::string &name ) const
+		{
+			return reinterpret_cast<Type>( Find( name ) );
+		}
+
+		// Indexes are built on first use and kept for the lifetime of the process
+		static std::shared_ptr<const SymbolIndex> Get( const Hook::Module &module );
+
+		// Searches the indexes of every loaded module, in load order. Modules
+		// not indexed yet are only indexed when the symbol tables of their own
+		// file hold the name, so names only in a debug companion need Get.
+		static void *FindInAllModules( const std::string &name );
+
+	private:
+		struct Entry
+		{
+			uintptr_t address;
+			uint32_t name;
+			uint32_t hash;
+			bool global;
+		};
+
+		bool Insert( const char *name, uintptr_t address, bool global );
+		bool Load( const std::string &path, bool is_debug_file );
+		void Rehash( size_t capacity );
+
+		std::string path;
+		uintptr_t base = 0;
+		size_t size = 0;
+		std::vector<Entry> entries;
+		std::string names;
+		std::chrono::nanoseconds build_time = std::chrono::nanoseconds::zero( );
+	};
+
+	// Resolves every name in a single pass over the exported symbol tables of
+	// each loaded module (DT_GNU_HASH or DT_HASH on Linux) instead of one dlsym
+	// call per name. Without a module, a name resolves to the first module in
+	// load order exporting it. Unlike dlsym( RTLD_DEFAULT ), that includes
+	// modules loaded with RTLD_LOCAL or in other namespaces, and ignores
+	// RTLD_DEEPBIND. Unresolved names are left as nullptr in addresses and
+	// appended to unresolved, if provided. Returns true if all were resolved.
+	bool ResolveSymbols(
+		const std::vector<std::string> &names,
+		std::vector<void *> &addresses,
+		std::vector<std::string> *unresolved = nullptr
+	);
+
+	bool ResolveSymbols(
+		const Hook::Module &module,
+		const std::vector<std::string> &names,
+		std::vector<void *> &addresses,
+		std::vector<std::string> *unresolved = nullptr
+	);
+}
@@ -0,0 +1,116 @@
+/*************************************************************************
+* Detouring::HookTransaction
+* A C++ class that allows you to create, enable and disable many
+* Detouring::Hook objects in a single patching pass.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace Detouring
+{
+	// Operations are only queued until Commit is called, at which point every
+	// hook is created and patched in one pass. If anything fails, the hooks
+	// are returned to the state they had before the commit.
+	// The queued hooks must outlive the transaction.
+	class HookTransaction
+	{
+	public:
+		HookTransaction( ) = default;
+
+		HookTransaction( const HookTransaction & ) = delete;
+		HookTransaction( HookTransaction && ) = delete;
+
+		~HookTransaction( );
+
+		HookTransaction &operator=( const HookTransaction & ) = delete;
+		HookTransaction &operator=( HookTransaction && ) = delete;
+
+		bool IsEmpty( ) const;
+		size_t GetSize( ) const;
+
+		bool Create( Hook &hook, const Hook::Target &target, void *detour, bool enable = true );
+		bool Create(
+			Hook &hook,
+			const Hook::Module &module,
+			const std::string &target,
+			void *detour,
+			bool enable = true
+		);
+
+		bool Enable( Hook &hook );
+		bool Disable( Hook &hook );
+
+		// Takes ownership of a hook queued on this transaction. It is handed
+		// to the callback once Commit succeeds, and destroyed along with the
+		// queued operations otherwise.
+		typedef std::function<void( std::unique_ptr<Hook> )> AdoptCallback;
+		void Adopt( std::unique_ptr<Hook> hook, AdoptCallback committed );
+
+		bool Commit( );
+		void Abort( );
+
+	private:
+		struct Operation
+		{
+			Hook *hook = nullptr;
+			void *address = nullptr;
+			bool enable = false;
+
+			// Only used by queued creations
+			bool create = false;
+			Hook::Target target;
+			Hook::Module module;
+			std::string symbol;
+			void *detour = nullptr;
+		};
+
+		struct Adopted
+		{
+			std::unique_ptr<Hook> hook;
+			AdoptCallback committed;
+		};
+
+		bool Queue( Hook &hook, bool enable );
+
+		std::vector<Operation> operations;
+		std::vector<Adopted> adopted;
+	};
+}
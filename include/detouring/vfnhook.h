@@ -59,6 +59,15 @@ void main( )
 #define PVFN( classptr, offset ) PVFN_( classptr, ( offset ) * sizeof( void * ) )
 #define VFN( classptr, offset ) VFN_( classptr, ( offset ) * sizeof( void * ) )
 
+// Writes the virtual table entry without leaving the table writable
+#define SETVFN( classptr, offset, function ) \
+	do \
+	{ \
+		const uintptr_t vfn_ = (uintptr_t)( function ); \
+		Detouring::WriteProtectedMemory( (void *)PVFN( classptr, offset ), &vfn_, sizeof( vfn_ ) ); \
+	} \
+	while( false )
+
 #if defined SYSTEM_WINDOWS
 
 #include <cstring>
@@ -112,16 +121,12 @@ private:
 	CVirtualCallGate funcname##Gate
 	
 #define HOOKVFUNC( classptr, index, funcname, newfunc ) \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), false ); \
 	funcname##Raw_Org = (void *)VFN( classptr, index ); \
 	funcname##Gate.Build( funcname##Raw_Org, newfunc, &funcname ); \
-	*(uintptr_t *)PVFN( classptr, index ) = funcname##Gate.Gate( ); \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), true )
+	SETVFN( classptr, index, funcname##Gate.Gate( ) )
 
 #define UNHOOKVFUNC( classptr, index, funcname ) \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), false ); \
-	*(uintptr_t *)PVFN( classptr, index ) = (uintptr_t)funcname##Raw_Org; \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), true )
+	SETVFN( classptr, index, funcname##Raw_Org )
 
 #elif defined SYSTEM_POSIX
 
@@ -131,15 +136,11 @@ private:
 	funcname##Func funcname = nullptr
 
 #define HOOKVFUNC( classptr, index, funcname, newfunc ) \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), false ); \
 	funcname = (funcname##Func)VFN( classptr, index ); \
-	*(uintptr_t *)PVFN( classptr, index ) = (uintptr_t)newfunc; \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), true )
+	SETVFN( classptr, index, newfunc )
 
 #define UNHOOKVFUNC( classptr, index, funcname  ) \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), false ); \
-	*(uintptr_t *)PVFN( classptr, index ) = (uintptr_t)funcname; \
-	Detouring::ProtectMemory( (void *)VTBL( classptr ), ( index + 1 ) * sizeof( void * ), true )
+	SETVFN( classptr, index, funcname )
 
 #endif
 
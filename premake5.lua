@@ -1,5 +1,10 @@
 local current_dir = _SCRIPT_DIR
 
+newoption({
+	trigger = "detouring-audit",
+	description = "Also build detouring_audit, an LD_AUDIT library for bind time hooks (Linux only)"
+})
+
 function IncludeDetouring()
 	local refcount = IncludePackage("detouring")
 
@@ -9,17 +9,46 @@ group("garrysmod_common")
 		files({
 			"include/detouring/*.hpp",
 			"include/detouring/*.h",
+			"source/*.hpp",
 			"source/*.cpp"
 		})
 		vpaths({
 			["Header files"] = {
 				"include/detouring/*.hpp",
-				"include/detouring/*.h"
+				"include/detouring/*.h",
+				"source/*.hpp"
 			},
 			["Source files"] = "source/*.cpp"
 		})
 		links({"hde", "minhook"})
 
+	if _OPTIONS["detouring-audit"] ~= nil and os.istarget("linux") then
+		project("detouring_audit")
+			kind("SharedLib")
+			location("projects/" .. os.target() .. "/" .. _ACTION)
+			targetdir("%{prj.location}/%{cfg.architecture}/%{cfg.buildcfg}")
+			debugdir("%{prj.location}/%{cfg.architecture}/%{cfg.buildcfg}")
+			objdir("!%{prj.location}/%{cfg.architecture}/%{cfg.buildcfg}/intermediate/%{prj.name}")
+			includedirs({"include/detouring", "source"})
+			visibility("Hidden")
+			files({
+				"include/detouring/audit.hpp",
+				"source/elf.hpp",
+				"source/elf.cpp",
+				"audit/*.cpp"
+			})
+			vpaths({
+				["Header files"] = {
+					"include/detouring/audit.hpp",
+					"source/elf.hpp"
+				},
+				["Source files"] = {
+					"source/elf.cpp",
+					"audit/*.cpp"
+				}
+			})
+	end
+
 	project("hde")
 		language("C")
 		kind("StaticLib")
@@ -0,0 +1,405 @@
+/*************************************************************************
+* Detouring::ResolutionCache
+* A C++ class that persists resolved symbols, signatures and virtual
+* table indices across runs.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "cache.hpp"
+#include "module.hpp"
+#include "mappedfile.hpp"
+#include "platform.hpp"
+
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+
+#if defined SYSTEM_WINDOWS
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+#include <io.h>
+
+#else
+
+#include <unistd.h>
+
+#endif
+
+namespace Detouring
+{
+	namespace
+	{
+		struct FileHeader
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t pointer_size;
+			uint64_t count;
+			uint64_t checksum;
+		};
+
+		constexpr char file_magic[8] = { 'D', 'E', 'T', 'C', 'A', 'C', 'H', 'E' };
+		constexpr uint32_t file_version = 1;
+
+		constexpr uint64_t fnv_offset = 0xCBF29CE484222325;
+		constexpr uint64_t fnv_prime = 0x100000001B3;
+
+		uint64_t GetFNVHash( const void *data, size_t size, uint64_t hash = fnv_offset )
+		{
+			const uint8_t *bytes = static_cast<const uint8_t *>( data );
+			for( size_t k = 0; k < size; ++k )
+				hash = ( hash ^ bytes[k] ) * fnv_prime;
+
+			return hash;
+		}
+
+		// Entries are sorted by module, then by key
+		template<typename Entry>
+		bool IsEntryLess( const Entry &lhs, const Entry &rhs )
+		{
+			return lhs.module < rhs.module || ( lhs.module == rhs.module && lhs.key < rhs.key );
+		}
+
+		uint64_t GetKey( char kind, const std::string &name )
+		{
+			return GetFNVHash( name.data( ), name.size( ), GetFNVHash( &kind, 1 ) );
+		}
+
+		uint64_t GetKey( const Signature &signature )
+		{
+			const char kind = 'p';
+			uint64_t hash = GetFNVHash( &kind, 1 );
+			hash = GetFNVHash( signature.GetBytes( ).data( ), signature.GetSize( ), hash );
+			return GetFNVHash( signature.GetMask( ).data( ), signature.GetSize( ), hash );
+		}
+
+		// Flushes the file down to the disk, so it is complete before a rename
+		// makes it replace the previous one, even if the system crashes
+		bool SyncFile( FILE *stream )
+		{
+			if( std::fflush( stream ) != 0 )
+				return false;
+
+#if defined SYSTEM_WINDOWS
+
+			return _commit( _fileno( stream ) ) == 0;
+
+#else
+
+			return fsync( fileno( stream ) ) == 0;
+
+#endif
+
+		}
+	}
+
+	ResolutionCache::ResolutionCache( ) = default;
+
+	ResolutionCache::ResolutionCache( const std::string &path )
+	{
+		Load( path );
+	}
+
+	ResolutionCache::~ResolutionCache( ) = default;
+
+	bool ResolutionCache::Load( const std::string &file_path )
+	{
+		std::lock_guard lock( mutex );
+
+		path = file_path;
+		added.clear( );
+		dirty = false;
+		return LoadLocked( );
+	}
+
+	bool ResolutionCache::LoadLocked( )
+	{
+		entries = nullptr;
+		entry_count = 0;
+
+		file = std::make_unique<MappedFile>( path );
+
+		const FileHeader *header = file->Get<FileHeader>( 0 );
+		if(
+			header == nullptr ||
+			std::memcmp( header->magic, file_magic, sizeof( file_magic ) ) != 0 ||
+			header->version != file_version ||
+			header->pointer_size != sizeof( void * ) ||
+			header->count != ( file->size - sizeof( FileHeader ) ) / sizeof( Entry ) ||
+			( file->size - sizeof( FileHeader ) ) % sizeof( Entry ) != 0
+		)
+		{
+			file.reset( );
+			return false;
+		}
+
+		const Entry *file_entries = file->Get<Entry>( sizeof( FileHeader ), static_cast<size_t>( header->count ) );
+		const size_t count = static_cast<size_t>( header->count );
+		if(
+			file_entries == nullptr ||
+			GetFNVHash( file_entries, count * sizeof( Entry ) ) != header->checksum ||
+			!std::is_sorted( file_entries, file_entries + count, IsEntryLess<Entry> )
+		)
+		{
+			file.reset( );
+			return false;
+		}
+
+		entries = file_entries;
+		entry_count = count;
+		return true;
+	}
+
+	bool ResolutionCache::Save( )
+	{
+		std::lock_guard lock( mutex );
+
+		if( path.empty( ) )
+			return false;
+
+		// Entries of modules that were rebuilt since the file was written are dropped
+		std::vector<Entry> merged;
+		merged.reserve( entry_count + added.size( ) );
+		for( size_t k = 0; k < entry_count; ++k )
+		{
+			const Entry &entry = entries[k];
+			const auto build = builds.find( entry.module );
+			if( build != builds.end( ) && build->second != entry.build )
+				continue;
+
+			if( added.find( { entry.module, entry.key } ) == added.end( ) )
+				merged.push_back( entry );
+		}
+
+		for( const auto &pair : added )
+			merged.push_back( pair.second );
+
+		std::sort( merged.begin( ), merged.end( ), IsEntryLess<Entry> );
+
+		FileHeader header = { };
+		std::memcpy( header.magic, file_magic, sizeof( file_magic ) );
+		header.version = file_version;
+		header.pointer_size = sizeof( void * );
+		header.count = merged.size( );
+		header.checksum = GetFNVHash( merged.data( ), merged.size( ) * sizeof( Entry ) );
+
+		const std::string temporary_path = path + ".tmp";
+		{
+			FILE *stream = std::fopen( temporary_path.c_str( ), "wb" );
+			bool written =
+				stream != nullptr &&
+				std::fwrite( &header, sizeof( header ), 1, stream ) == 1 &&
+				std::fwrite( merged.data( ), sizeof( Entry ), merged.size( ), stream ) == merged.size( ) &&
+				SyncFile( stream );
+			if( stream != nullptr && std::fclose( stream ) != 0 )
+				written = false;
+
+			if( !written )
+			{
+				std::remove( temporary_path.c_str( ) );
+				return false;
+			}
+		}
+
+		// Windows refuses to replace a file that is still mapped
+		entries = nullptr;
+		entry_count = 0;
+		file.reset( );
+
+#if defined SYSTEM_WINDOWS
+
+		// rename refuses to replace an existing file here, and removing it
+		// first would lose the cache if the rename then failed
+		const bool saved = MoveFileExA( temporary_path.c_str( ), path.c_str( ), MOVEFILE_REPLACE_EXISTING ) != 0;
+
+#else
+
+		const bool saved = std::rename( temporary_path.c_str( ), path.c_str( ) ) == 0;
+
+#endif
+
+		if( !saved )
+			std::remove( temporary_path.c_str( ) );
+
+		// Whatever ended up on disk is mapped again, and the added entries are
+		// only dropped once they are part of it
+		LoadLocked( );
+		if( saved )
+		{
+			added.clear( );
+			dirty = false;
+		}
+
+		return saved;
+	}
+
+	const std::string &ResolutionCache::GetPath( ) const
+	{
+		return path;
+	}
+
+	size_t ResolutionCache::GetSize( ) const
+	{
+		std::lock_guard lock( mutex );
+		return entry_count + added.size( );
+	}
+
+	bool ResolutionCache::IsDirty( ) const
+	{
+		std::lock_guard lock( mutex );
+		return dirty;
+	}
+
+	void *ResolutionCache::FindSymbol( const Hook::Module &module, const std::string &name )
+	{
+		uint64_t offset = 0;
+		if( !Find( module, GetKey( 's', name ), true, offset ) )
+			return nullptr;
+
+		return reinterpret_cast<void *>( static_cast<uintptr_t>( offset ) );
+	}
+
+	bool ResolutionCache::AddSymbol( const Hook::Module &module, const std::string &name, void *address )
+	{
+		return Add( module, GetKey( 's', name ), true, reinterpret_cast<uintptr_t>( address ) );
+	}
+
+	void *ResolutionCache::FindSignature( const Hook::Module &module, const Signature &signature )
+	{
+		uint64_t offset = 0;
+		if( !signature.IsValid( ) || !Find( module, GetKey( signature ), true, offset ) )
+			return nullptr;
+
+		return reinterpret_cast<void *>( static_cast<uintptr_t>( offset ) );
+	}
+
+	bool ResolutionCache::AddSignature( const Hook::Module &module, const Signature &signature, void *address )
+	{
+		return signature.IsValid( ) && Add( module, GetKey( signature ), true, reinterpret_cast<uintptr_t>( address ) );
+	}
+
+	bool ResolutionCache::FindVirtualIndex( const Hook::Module &module, const std::string &name, size_t &index )
+	{
+		uint64_t value = 0;
+		if( !Find( module, GetKey( 'v', name ), false, value ) )
+			return false;
+
+		index = static_cast<size_t>( value );
+		return true;
+	}
+
+	bool ResolutionCache::AddVirtualIndex( const Hook::Module &module, const std::string &name, size_t index )
+	{
+		return Add( module, GetKey( 'v', name ), false, index );
+	}
+
+	bool ResolutionCache::GetModuleKey( const Hook::Module &module, ModuleKey &key )
+	{
+		ModuleInfo info;
+		if( !GetModuleInfo( module, info ) || info.build_id.empty( ) )
+			return false;
+
+		key.module = GetFNVHash( info.path.data( ), info.path.size( ) );
+		key.build = GetFNVHash( info.build_id.data( ), info.build_id.size( ) );
+		key.base = info.base;
+		key.end = info.base;
+		for( const MemoryRegion &segment : info.segments )
+			key.end = std::max( key.end, segment.end );
+
+		return true;
+	}
+
+	bool ResolutionCache::Find( const Hook::Module &module, uint64_t key, bool is_offset, uint64_t &value )
+	{
+		ModuleKey module_key;
+		if( !GetModuleKey( module, module_key ) )
+			return false;
+
+		std::lock_guard lock( mutex );
+
+		builds[module_key.module] = module_key.build;
+
+		const Entry *entry = nullptr;
+		const auto it = added.find( { module_key.module, key } );
+		if( it != added.end( ) )
+		{
+			entry = &it->second;
+		}
+		else
+		{
+			const Entry target = { module_key.module, 0, key, 0 };
+			const Entry *found = std::lower_bound( entries, entries + entry_count, target, IsEntryLess<Entry> );
+			if( found != entries + entry_count && found->module == module_key.module && found->key == key )
+				entry = found;
+		}
+
+		if( entry == nullptr || entry->build != module_key.build )
+			return false;
+
+		if( !is_offset )
+		{
+			value = entry->value;
+			return true;
+		}
+
+		if( entry->value >= module_key.end - module_key.base )
+			return false;
+
+		value = module_key.base + entry->value;
+		return true;
+	}
+
+	bool ResolutionCache::Add( const Hook::Module &module, uint64_t key, bool is_offset, uint64_t value )
+	{
+		ModuleKey module_key;
+		if( !GetModuleKey( module, module_key ) )
+			return false;
+
+		if( is_offset )
+		{
+			if( value < module_key.base || value >= module_key.end )
+				return false;
+
+			value -= module_key.base;
+		}
+
+		std::lock_guard lock( mutex );
+
+		builds[module_key.module] = module_key.build;
+		added[{ module_key.module, key }] = { module_key.module, module_key.build, key, value };
+		dirty = true;
+		return true;
+	}
+}
@@ -0,0 +1,382 @@
+/*************************************************************************
+* Detouring::CommitHookCode
+* Internal hook toggling on Linux that serializes every core with
+* membarrier instead of stopping threads.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "commit.hpp"
+#include "freeze.hpp"
+#include "helpers.hpp"
+#include "platform.hpp"
+#include "flatmap.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if defined SYSTEM_LINUX && ( defined ARCHITECTURE_X86 || defined ARCHITECTURE_X86_64 )
+
+#define DETOURING_CODE_COMMIT 1
+
+#include "hde.h"
+
+#include <atomic>
+#include <csignal>
+
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#endif
+
+namespace Detouring
+{
+	void ReadHookCode( void *target, uint8_t *code )
+	{
+		std::memcpy( code, target, HookCodeSize );
+	}
+
+	size_t CompareHookCode( void *target, const uint8_t *original )
+	{
+		const uint8_t *code = static_cast<const uint8_t *>( target );
+		size_t size = 0;
+		for( size_t k = 0; k < HookCodeSize; ++k )
+			if( code[k] != original[k] )
+				size = k + 1;
+
+		return size;
+	}
+
+#if defined DETOURING_CODE_COMMIT
+
+	namespace
+	{
+		struct HookCode
+		{
+			void *trampoline;
+			uint8_t original[HookCodeSize];
+			uint8_t patched[HookCodeSize];
+			size_t size;
+
+			// Whether the patch covers more than the first original instruction
+			bool spans_instructions;
+		};
+
+		struct HookCodes
+		{
+			std::mutex mutex;
+			FlatMap<HookCode> codes;
+		};
+
+		// Never destroyed, since hooks with static storage duration are
+		// destroyed during exit
+		HookCodes &GetHookCodes( )
+		{
+			static HookCodes *codes = new HookCodes( );
+			return *codes;
+		}
+
+		bool SynchronizeCores( )
+		{
+			return syscall( __NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, 0 ) == 0;
+		}
+
+		// Addresses that held a temporary int3, looked up by the SIGTRAP
+		// handler. Entries are only overwritten by later commits, since a
+		// thread may take the trap just before its int3 is replaced.
+		// Commits are serialized by the hook codes mutex.
+		static constexpr size_t MaximumBreakpoints = 64;
+		std::atomic<uintptr_t> breakpoints[MaximumBreakpoints];
+		size_t next_breakpoint = 0;
+		struct sigaction previous_action;
+
+		void HandleBreakpoint( int signal, siginfo_t *info, void *context )
+		{
+			ucontext_t *ucontext = static_cast<ucontext_t *>( context );
+
+#if defined ARCHITECTURE_X86_64
+
+			greg_t &instruction = ucontext->uc_mcontext.gregs[REG_RIP];
+
+#else
+
+			greg_t &instruction = ucontext->uc_mcontext.gregs[REG_EIP];
+
+#endif
+
+			// The int3 was executed, so back up and run the address again,
+			// which holds the finished patch once the commit is done
+			const uintptr_t address = static_cast<uintptr_t>( instruction ) - 1;
+			for( const std::atomic<uintptr_t> &breakpoint : breakpoints )
+				if( breakpoint.load( std::memory_order_acquire ) == address )
+				{
+					instruction = static_cast<greg_t>( address );
+					return;
+				}
+
+			if( ( previous_action.sa_flags & SA_SIGINFO ) != 0 && previous_action.sa_sigaction != nullptr )
+				previous_action.sa_sigaction( signal, info, context );
+			else if( previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN )
+				previous_action.sa_handler( signal );
+			else
+			{
+				sigaction( SIGTRAP, &previous_action, nullptr );
+				raise( SIGTRAP );
+			}
+		}
+
+		bool InstallBreakpointHandler( )
+		{
+			static const bool installed = []( )
+			{
+				struct sigaction action = { };
+				action.sa_sigaction = HandleBreakpoint;
+				action.sa_flags = SA_SIGINFO | SA_RESTART;
+				sigemptyset( &action.sa_mask );
+				return sigaction( SIGTRAP, &action, &previous_action ) == 0;
+			}( );
+			return installed;
+		}
+
+		bool IsAtomicPatch( const void *address, size_t size )
+		{
+			return ( reinterpret_cast<uintptr_t>( address ) & 7 ) + size <= 8;
+		}
+
+		// Rewrites the aligned word holding the bytes in a single store
+		void StoreAtomically( uint8_t *address, const uint8_t *bytes, size_t size )
+		{
+			uint64_t *word = reinterpret_cast<uint64_t *>( reinterpret_cast<uintptr_t>( address ) & ~static_cast<uintptr_t>( 7 ) );
+			uint64_t value = __atomic_load_n( word, __ATOMIC_RELAXED );
+			std::memcpy( reinterpret_cast<uint8_t *>( &value ) + ( address - reinterpret_cast<uint8_t *>( word ) ), bytes, size );
+			__atomic_store_n( word, value, __ATOMIC_RELEASE );
+		}
+
+		struct Patch
+		{
+			uint8_t *address;
+			const uint8_t *bytes;
+			size_t size;
+		};
+
+		size_t GetInstructionLength( const uint8_t *code )
+		{
+			uint8_t bytes[32] = { };
+			std::memcpy( bytes, code, HookCodeSize );
+
+#if defined ARCHITECTURE_X86_64
+
+			hde64s instruction;
+			return hde64_disasm( bytes, &instruction );
+
+#else
+
+			hde32s instruction;
+			return hde32_disasm( bytes, &instruction );
+
+#endif
+
+		}
+	}
+
+	bool IsCodeCommitAvailable( )
+	{
+		static const bool available = []( )
+		{
+			const long commands = syscall( __NR_membarrier, MEMBARRIER_CMD_QUERY, 0 );
+			return commands > 0 &&
+				( commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE ) != 0 &&
+				syscall( __NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0 ) == 0;
+		}( );
+		return available;
+	}
+
+	void RecordHookCode( void *target, void *trampoline, const uint8_t *original )
+	{
+		if( !IsCodeCommitAvailable( ) )
+			return;
+
+		HookCode code;
+		code.trampoline = trampoline;
+		std::memcpy( code.original, original, HookCodeSize );
+		ReadHookCode( target, code.patched );
+
+		code.size = CompareHookCode( target, original );
+		if( code.size == 0 )
+			return;
+
+		code.spans_instructions = GetInstructionLength( code.original ) < code.size;
+
+		HookCodes &codes = GetHookCodes( );
+		std::lock_guard lock( codes.mutex );
+		codes.codes[target] = code;
+	}
+
+	bool HasHookCode( void *target )
+	{
+		HookCodes &codes = GetHookCodes( );
+		std::lock_guard lock( codes.mutex );
+		return codes.codes.count( target ) != 0;
+	}
+
+	void ForgetHookCode( void *target )
+	{
+		HookCodes &codes = GetHookCodes( );
+		std::lock_guard lock( codes.mutex );
+		codes.codes.erase( target );
+	}
+
+	bool CommitHookCode( const HookCodeChange *changes, size_t count )
+	{
+		HookCodes &codes = GetHookCodes( );
+		std::lock_guard lock( codes.mutex );
+
+		std::vector<Patch> patches;
+		std::vector<FrozenCode> frozen_codes;
+		std::vector<void *> trampolines;
+		size_t breakpoint_count = 0;
+		for( size_t k = 0; k < count; ++k )
+		{
+			const auto it = codes.codes.find( changes[k].target );
+			if( it == codes.codes.end( ) )
+				return false;
+
+			const HookCode &code = it->second;
+			Patch patch = {
+				static_cast<uint8_t *>( changes[k].target ),
+				changes[k].enable ? code.patched : code.original,
+				code.size
+			};
+			if( !IsAtomicPatch( patch.address, patch.size ) )
+				++breakpoint_count;
+
+			if( changes[k].enable && code.spans_instructions )
+			{
+				frozen_codes.push_back( { patch.address, code.original, code.size } );
+				trampolines.push_back( code.trampoline );
+			}
+
+			patches.push_back( patch );
+		}
+
+		if( breakpoint_count > MaximumBreakpoints || ( breakpoint_count != 0 && !InstallBreakpointHandler( ) ) )
+			return false;
+
+		// Patches sharing pages are made writable together, and the pages
+		// get their own protection back once this returns
+		WritableScope scope;
+		for( const Patch &patch : patches )
+			scope.Add( patch.address, patch.size );
+
+		if( !scope.Apply( ) )
+			return false;
+
+		// Stopped threads cannot see any patch half written, and those caught
+		// in the middle of one are moved to its trampoline. A thread could
+		// be left inside the overwritten instructions by the int3 sequence
+		// below, so nothing is written when threads do not stop.
+		if( !frozen_codes.empty( ) )
+		{
+			ThreadFreeze freeze;
+			if( !freeze.Freeze( frozen_codes.data( ), frozen_codes.size( ) ) )
+				return false;
+
+			for( const Patch &patch : patches )
+				std::memcpy( patch.address, patch.bytes, patch.size );
+
+			for( size_t k = 0; k < frozen_codes.size( ); ++k )
+				freeze.RelocateThreads( frozen_codes[k], trampolines[k] );
+
+			const bool synchronized = SynchronizeCores( );
+			freeze.Release( );
+			return synchronized;
+		}
+
+		// Every thread reaching a patch site sees the int3 before the tail
+		// changes, and the tail before the first byte changes
+		bool synchronized = true;
+		if( breakpoint_count != 0 )
+		{
+			for( const Patch &patch : patches )
+				if( !IsAtomicPatch( patch.address, patch.size ) )
+				{
+					breakpoints[next_breakpoint].store( reinterpret_cast<uintptr_t>( patch.address ), std::memory_order_release );
+					next_breakpoint = ( next_breakpoint + 1 ) % MaximumBreakpoints;
+					StoreAtomically( patch.address, reinterpret_cast<const uint8_t *>( "\xCC" ), 1 );
+				}
+
+			synchronized = SynchronizeCores( ) && synchronized;
+
+			for( const Patch &patch : patches )
+				if( !IsAtomicPatch( patch.address, patch.size ) )
+					std::memcpy( patch.address + 1, patch.bytes + 1, patch.size - 1 );
+
+			synchronized = SynchronizeCores( ) && synchronized;
+		}
+
+		for( const Patch &patch : patches )
+			if( IsAtomicPatch( patch.address, patch.size ) )
+				StoreAtomically( patch.address, patch.bytes, patch.size );
+			else
+				StoreAtomically( patch.address, patch.bytes, 1 );
+
+		return SynchronizeCores( ) && synchronized;
+	}
+
+#else
+
+	bool IsCodeCommitAvailable( )
+	{
+		return false;
+	}
+
+	void RecordHookCode( void *, void *, const uint8_t * )
+	{ }
+
+	bool HasHookCode( void * )
+	{
+		return false;
+	}
+
+	void ForgetHookCode( void * )
+	{ }
+
+	bool CommitHookCode( const HookCodeChange *, size_t )
+	{
+		return false;
+	}
+
+#endif
+
+}
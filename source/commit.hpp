@@ -0,0 +1,80 @@
+/*************************************************************************
+* Detouring::CommitHookCode
+* Internal hook toggling on Linux that serializes every core with
+* membarrier instead of stopping threads.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace Detouring
+{
+	// Bytes read around a target to find what MinHook patched
+	static constexpr size_t HookCodeSize = 8;
+
+	// Size of the jump MinHook writes over the start of a target
+	static constexpr size_t HookJumpSize = 5;
+
+	// Whether membarrier can serialize the cores of every thread
+	bool IsCodeCommitAvailable( );
+
+	// The first enable of a hook goes through MinHook, after which the
+	// patched bytes are compared with the original ones read before it.
+	// Hooks with recorded code toggle through CommitHookCode from then on.
+	void RecordHookCode( void *target, void *trampoline, const uint8_t *original );
+	bool HasHookCode( void *target );
+	void ForgetHookCode( void *target );
+
+	// Patches that fit in an aligned 8-byte word are a single atomic store,
+	// others are written behind an int3 that makes threads reaching it retry.
+	// Every core is serialized after each step, once for the whole batch.
+	// Enabling a patch that covers more than the first instruction of its
+	// target stops every thread instead, so threads caught in the middle of
+	// it can be moved to its trampoline, and fails when they cannot stop.
+	struct HookCodeChange
+	{
+		void *target;
+		bool enable;
+	};
+
+	bool CommitHookCode( const HookCodeChange *changes, size_t count );
+
+	// Reads the bytes MinHook would patch, for RecordHookCode
+	void ReadHookCode( void *target, uint8_t *code );
+
+	// Number of bytes at the target up to the last one that differs from
+	// the original ones
+	size_t CompareHookCode( void *target, const uint8_t *original );
+}
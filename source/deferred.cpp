@@ -0,0 +1,219 @@
+/*************************************************************************
+* Detouring::DeferHook
+* Internal queue of hooks waiting for their module to be loaded.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "deferred.hpp"
+#include "transaction.hpp"
+#include "module.hpp"
+#include "loader.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace Detouring
+{
+	namespace
+	{
+		struct DeferredHook
+		{
+			Hook *hook;
+			Hook::Module module;
+			std::string name;
+			std::string target;
+			void *detour;
+		};
+
+		// Recursive, since a failed batch destroys the hooks it created,
+		// which checks this queue again
+		struct DeferredHooks
+		{
+			std::recursive_mutex mutex;
+			std::vector<DeferredHook> hooks;
+		};
+
+		// Never destroyed, since hooks with static storage duration are
+		// destroyed during exit
+		DeferredHooks &GetDeferredHooks( )
+		{
+			static DeferredHooks *deferred = new DeferredHooks( );
+			return *deferred;
+		}
+
+		// Creates and enables the hooks in a single transaction, falling back
+		// to one at a time so a missing symbol does not hold the rest back
+		void ApplyHooks( const std::vector<DeferredHook> &hooks )
+		{
+			if( hooks.empty( ) )
+				return;
+
+			HookTransaction transaction;
+			for( const DeferredHook &deferred : hooks )
+				transaction.Create( *deferred.hook, deferred.module, deferred.target, deferred.detour );
+
+			if( transaction.Commit( ) )
+				return;
+
+			for( const DeferredHook &deferred : hooks )
+				if( deferred.hook->Create( deferred.module, deferred.target, deferred.detour ) )
+					deferred.hook->Enable( );
+		}
+
+		// Moves the matching hooks out of the queue, the caller holds its lock
+		template<typename Predicate>
+		std::vector<DeferredHook> TakeHooks( DeferredHooks &deferred, Predicate &&predicate )
+		{
+			std::vector<DeferredHook> taken;
+			const auto it = std::stable_partition(
+				deferred.hooks.begin( ),
+				deferred.hooks.end( ),
+				[&predicate]( const DeferredHook &hook )
+				{
+					return !predicate( hook );
+				}
+			);
+
+			std::move( it, deferred.hooks.end( ), std::back_inserter( taken ) );
+			deferred.hooks.erase( it, deferred.hooks.end( ) );
+			return taken;
+		}
+
+		bool IsModuleLoaded( const std::string &name )
+		{
+			ModuleInfo info;
+			return GetModuleInfo( Hook::Module( name ), info );
+		}
+
+#if defined SYSTEM_LINUX
+
+		void ApplyDeferredHooks( const DynamicInfo &module )
+		{
+			DeferredHooks &deferred = GetDeferredHooks( );
+			std::lock_guard lock( deferred.mutex );
+			if( deferred.hooks.empty( ) )
+				return;
+
+			ApplyHooks( TakeHooks( deferred, [&module]( const DeferredHook &hook )
+			{
+				return IsModuleName( hook.name, module.path.c_str( ) );
+			} ) );
+		}
+
+#endif
+
+	}
+
+	bool DeferHook( Hook &hook, const Hook::Module &module, const std::string &target, void *detour )
+	{
+		if( hook.IsValid( ) || IsDeferredHook( hook ) || !module.IsValid( ) || target.empty( ) || detour == nullptr )
+			return false;
+
+		if( module.IsPointer( ) )
+			return hook.Create( module, target, detour ) && hook.Enable( );
+
+		DeferredHooks &deferred = GetDeferredHooks( );
+		const std::string name = GetModuleName( module );
+
+		{
+			std::lock_guard lock( deferred.mutex );
+			deferred.hooks.push_back( { &hook, module, name, target, detour } );
+		}
+
+#if defined SYSTEM_LINUX
+
+		AddModuleLoadCallback( ApplyDeferredHooks );
+
+		// Otherwise the hook would wait for the next hook creation to notice the load
+		WatchDlopen( );
+
+#endif
+
+		// Queued before checking, so a load happening in between is not missed
+		if( IsModuleLoaded( name ) )
+		{
+			std::lock_guard lock( deferred.mutex );
+			ApplyHooks( TakeHooks( deferred, [&hook]( const DeferredHook &deferred_hook )
+			{
+				return deferred_hook.hook == &hook;
+			} ) );
+		}
+
+		return true;
+	}
+
+	bool CancelDeferredHook( const Hook &hook )
+	{
+		DeferredHooks &deferred = GetDeferredHooks( );
+		std::lock_guard lock( deferred.mutex );
+		return !TakeHooks( deferred, [&hook]( const DeferredHook &deferred_hook )
+		{
+			return deferred_hook.hook == &hook;
+		} ).empty( );
+	}
+
+	bool IsDeferredHook( const Hook &hook )
+	{
+		DeferredHooks &deferred = GetDeferredHooks( );
+		std::lock_guard lock( deferred.mutex );
+		return std::any_of( deferred.hooks.begin( ), deferred.hooks.end( ), [&hook]( const DeferredHook &deferred_hook )
+		{
+			return deferred_hook.hook == &hook;
+		} );
+	}
+
+	void CheckDeferredHooks( )
+	{
+
+#if defined SYSTEM_LINUX
+
+		CheckLoadedModules( );
+
+#else
+
+		DeferredHooks &deferred = GetDeferredHooks( );
+		std::lock_guard lock( deferred.mutex );
+		std::vector<std::string> loaded;
+		for( const DeferredHook &hook : deferred.hooks )
+			if( std::find( loaded.begin( ), loaded.end( ), hook.name ) == loaded.end( ) && IsModuleLoaded( hook.name ) )
+				loaded.push_back( hook.name );
+
+		ApplyHooks( TakeHooks( deferred, [&loaded]( const DeferredHook &hook )
+		{
+			return std::find( loaded.begin( ), loaded.end( ), hook.name ) != loaded.end( );
+		} ) );
+
+#endif
+
+	}
+}
@@ -0,0 +1,311 @@
+/*************************************************************************
+* Detouring ELF helpers
+* Internal helpers for reading ELF structures.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "elf.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace Detouring
+{
+	uint32_t GetGNUHash( const char *name )
+	{
+		uint32_t hash = 5381;
+		for( const uint8_t *c = reinterpret_cast<const uint8_t *>( name ); *c != '\0'; ++c )
+			hash = hash * 33 + *c;
+
+		return hash;
+	}
+
+	bool GetBuildId( const void *notes, size_t size, std::string &build_id )
+	{
+		// Elf32_Nhdr and Elf64_Nhdr share the same layout
+		struct NoteHeader
+		{
+			uint32_t name_size;
+			uint32_t descriptor_size;
+			uint32_t type;
+		};
+
+		static constexpr uint32_t note_gnu_build_id = 3;
+
+		const uint8_t *cursor = static_cast<const uint8_t *>( notes );
+		const uint8_t *end = cursor + size;
+		while( static_cast<size_t>( end - cursor ) >= sizeof( NoteHeader ) )
+		{
+			NoteHeader header;
+			std::memcpy( &header, cursor, sizeof( header ) );
+			cursor += sizeof( header );
+
+			const size_t name_size = ( static_cast<size_t>( header.name_size ) + 3 ) & ~static_cast<size_t>( 3 );
+			const size_t descriptor_size =
+				( static_cast<size_t>( header.descriptor_size ) + 3 ) & ~static_cast<size_t>( 3 );
+			if( name_size > static_cast<size_t>( end - cursor ) ||
+				descriptor_size > static_cast<size_t>( end - cursor - name_size ) )
+				return false;
+
+			if(
+				header.type == note_gnu_build_id &&
+				header.name_size == 4 &&
+				std::memcmp( cursor, "GNU", 4 ) == 0 &&
+				header.descriptor_size != 0
+			)
+			{
+				build_id.assign( reinterpret_cast<const char *>( cursor + name_size ), header.descriptor_size );
+				return true;
+			}
+
+			cursor += name_size + descriptor_size;
+		}
+
+		return false;
+	}
+
+#if defined SYSTEM_LINUX
+
+	static uint32_t GetSysVHash( const char *name )
+	{
+		uint32_t hash = 0;
+		for( const uint8_t *c = reinterpret_cast<const uint8_t *>( name ); *c != '\0'; ++c )
+		{
+			hash = ( hash << 4 ) + *c;
+			const uint32_t high = hash & 0xF0000000;
+			if( high != 0 )
+				hash ^= high >> 24;
+
+			hash &= ~high;
+		}
+
+		return hash;
+	}
+
+	static bool IsDefinedSymbol( const DynamicInfo &info, const ElfW( Sym ) &symbol, size_t index )
+	{
+		const uint8_t type = DETOURING_ELF_ST_TYPE( symbol.st_info );
+		const uint8_t binding = DETOURING_ELF_ST_BIND( symbol.st_info );
+		return symbol.st_shndx != SHN_UNDEF &&
+			symbol.st_value != 0 &&
+			( type == STT_FUNC || type == STT_OBJECT || type == STT_GNU_IFUNC || type == STT_NOTYPE ) &&
+			( binding == STB_GLOBAL || binding == STB_WEAK || binding == STB_GNU_UNIQUE ) &&
+			( info.versions == nullptr || ( info.versions[index] & 0x8000 ) == 0 );
+	}
+
+	bool GetDynamicInfo( const dl_phdr_info &phdr, DynamicInfo &info )
+	{
+		const ElfW( Dyn ) *dynamic = nullptr;
+		for( ElfW( Half ) k = 0; k < phdr.dlpi_phnum; ++k )
+			if( phdr.dlpi_phdr[k].p_type == PT_DYNAMIC )
+				dynamic = reinterpret_cast<const ElfW( Dyn ) *>( phdr.dlpi_addr + phdr.dlpi_phdr[k].p_vaddr );
+
+		return GetDynamicInfo( static_cast<uintptr_t>( phdr.dlpi_addr ), dynamic, info );
+	}
+
+	bool GetDynamicInfo( uintptr_t base, const ElfW( Dyn ) *dynamic, DynamicInfo &info )
+	{
+		if( dynamic == nullptr )
+			return false;
+
+		info.base = base;
+
+		// glibc relocates these entries in place while other loaders leave them as offsets
+		const auto relocate = [&info]( ElfW( Addr ) address )
+		{
+			return address < info.base ? info.base + address : static_cast<uintptr_t>( address );
+		};
+
+		for( const ElfW( Dyn ) *entry = dynamic; entry->d_tag != DT_NULL; ++entry )
+			switch( entry->d_tag )
+			{
+			case DT_SYMTAB:
+				info.symbols = reinterpret_cast<const ElfW( Sym ) *>( relocate( entry->d_un.d_ptr ) );
+				break;
+
+			case DT_STRTAB:
+				info.strings = reinterpret_cast<const char *>( relocate( entry->d_un.d_ptr ) );
+				break;
+
+			case DT_STRSZ:
+				info.strings_size = static_cast<size_t>( entry->d_un.d_val );
+				break;
+
+			case DT_GNU_HASH:
+				info.gnu_hash = reinterpret_cast<const uint32_t *>( relocate( entry->d_un.d_ptr ) );
+				break;
+
+			case DT_HASH:
+				info.hash = reinterpret_cast<const ElfW( Word ) *>( relocate( entry->d_un.d_ptr ) );
+				break;
+
+			case DT_VERSYM:
+				info.versions = reinterpret_cast<const ElfW( Half ) *>( relocate( entry->d_un.d_ptr ) );
+				break;
+
+			case DETOURING_ELF_DT_RELOCATIONS:
+				info.relocations =
+					reinterpret_cast<const DETOURING_ELF_RELOCATION *>( relocate( entry->d_un.d_ptr ) );
+				break;
+
+			case DETOURING_ELF_DT_RELOCATIONS_SIZE:
+				info.relocations_size = static_cast<size_t>( entry->d_un.d_val );
+				break;
+
+			case DT_JMPREL:
+				info.plt_relocations =
+					reinterpret_cast<const DETOURING_ELF_RELOCATION *>( relocate( entry->d_un.d_ptr ) );
+				break;
+
+			case DT_PLTRELSZ:
+				info.plt_relocations_size = static_cast<size_t>( entry->d_un.d_val );
+				break;
+
+			default:
+				break;
+			}
+
+		return info.symbols != nullptr && info.strings != nullptr;
+	}
+
+	const ElfW( Sym ) *FindDynamicSymbol( const DynamicInfo &info, const char *name, uint32_t gnu_hash )
+	{
+		if( info.symbols == nullptr || info.strings == nullptr )
+			return nullptr;
+
+		if( info.gnu_hash != nullptr )
+		{
+			static constexpr uint32_t word_bits = sizeof( ElfW( Addr ) ) * 8;
+
+			const uint32_t bucket_count = info.gnu_hash[0];
+			const uint32_t symbol_offset = info.gnu_hash[1];
+			const uint32_t bloom_size = info.gnu_hash[2];
+			const uint32_t bloom_shift = info.gnu_hash[3];
+			if( bucket_count == 0 || bloom_size == 0 )
+				return nullptr;
+
+			const ElfW( Addr ) *bloom = reinterpret_cast<const ElfW( Addr ) *>( info.gnu_hash + 4 );
+			const uint32_t *buckets = reinterpret_cast<const uint32_t *>( bloom + bloom_size );
+			const uint32_t *chain = buckets + bucket_count;
+
+			const ElfW( Addr ) word = bloom[( gnu_hash / word_bits ) % bloom_size];
+			const ElfW( Addr ) mask =
+				( static_cast<ElfW( Addr )>( 1 ) << ( gnu_hash % word_bits ) ) |
+				( static_cast<ElfW( Addr )>( 1 ) << ( ( gnu_hash >> bloom_shift ) % word_bits ) );
+			if( ( word & mask ) != mask )
+				return nullptr;
+
+			uint32_t index = buckets[gnu_hash % bucket_count];
+			if( index < symbol_offset )
+				return nullptr;
+
+			for( ; ; ++index )
+			{
+				const uint32_t hash = chain[index - symbol_offset];
+				const ElfW( Sym ) &symbol = info.symbols[index];
+				if(
+					( hash | 1 ) == ( gnu_hash | 1 ) &&
+					std::strcmp( info.strings + symbol.st_name, name ) == 0 &&
+					IsDefinedSymbol( info, symbol, index )
+				)
+					return &symbol;
+
+				if( ( hash & 1 ) != 0 )
+					break;
+			}
+
+			return nullptr;
+		}
+
+		if( info.hash != nullptr )
+		{
+			const ElfW( Word ) bucket_count = info.hash[0];
+			if( bucket_count == 0 )
+				return nullptr;
+
+			const ElfW( Word ) *buckets = info.hash + 2;
+			const ElfW( Word ) *chain = buckets + bucket_count;
+			for(
+				ElfW( Word ) index = buckets[GetSysVHash( name ) % bucket_count];
+				index != STN_UNDEF;
+				index = chain[index]
+			)
+			{
+				const ElfW( Sym ) &symbol = info.symbols[index];
+				if( std::strcmp( info.strings + symbol.st_name, name ) == 0 && IsDefinedSymbol( info, symbol, index ) )
+					return &symbol;
+			}
+		}
+
+		return nullptr;
+	}
+
+	size_t FindImportSlots( const DynamicInfo &info, const char *name, std::vector<void **> &slots )
+	{
+		if( info.symbols == nullptr || info.strings == nullptr )
+			return 0;
+
+		const size_t count = slots.size( );
+		const auto collect = [&]( const DETOURING_ELF_RELOCATION *relocations, size_t size )
+		{
+			if( relocations == nullptr )
+				return;
+
+			const DETOURING_ELF_RELOCATION *end = relocations + size / sizeof( DETOURING_ELF_RELOCATION );
+			for( const DETOURING_ELF_RELOCATION *relocation = relocations; relocation != end; ++relocation )
+			{
+				const auto type = DETOURING_ELF_R_TYPE( relocation->r_info );
+				if( type != DETOURING_ELF_R_JUMP_SLOT && type != DETOURING_ELF_R_GLOB_DAT )
+					continue;
+
+				const auto index = DETOURING_ELF_R_SYM( relocation->r_info );
+				const ElfW( Sym ) &symbol = info.symbols[index];
+				if(
+					index == STN_UNDEF ||
+					( info.strings_size != 0 && symbol.st_name >= info.strings_size ) ||
+					std::strcmp( info.strings + symbol.st_name, name ) != 0
+				)
+					continue;
+
+				void **slot = reinterpret_cast<void **>( info.base + relocation->r_offset );
+				if( std::find( slots.begin( ), slots.end( ), slot ) == slots.end( ) )
+					slots.push_back( slot );
+			}
+		};
+
+		collect( info.plt_relocations, info.plt_relocations_size );
+		collect( info.relocations, info.relocations_size );
+		return slots.size( ) - count;
+	}
+
+#endif
+}
@@ -0,0 +1,123 @@
+/*************************************************************************
+* Detouring ELF helpers
+* Internal helpers for reading ELF structures.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "platform.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#if defined SYSTEM_LINUX
+
+#include <link.h>
+
+#if defined ARCHITECTURE_X86_64
+
+#define DETOURING_ELF_CLASS ELFCLASS64
+#define DETOURING_ELF_ST_TYPE ELF64_ST_TYPE
+#define DETOURING_ELF_ST_BIND ELF64_ST_BIND
+#define DETOURING_ELF_R_SYM ELF64_R_SYM
+#define DETOURING_ELF_R_TYPE ELF64_R_TYPE
+#define DETOURING_ELF_DT_RELOCATIONS DT_RELA
+#define DETOURING_ELF_DT_RELOCATIONS_SIZE DT_RELASZ
+#define DETOURING_ELF_R_JUMP_SLOT R_X86_64_JUMP_SLOT
+#define DETOURING_ELF_R_GLOB_DAT R_X86_64_GLOB_DAT
+
+typedef ElfW( Rela ) DETOURING_ELF_RELOCATION;
+
+#else
+
+#define DETOURING_ELF_CLASS ELFCLASS32
+#define DETOURING_ELF_ST_TYPE ELF32_ST_TYPE
+#define DETOURING_ELF_ST_BIND ELF32_ST_BIND
+#define DETOURING_ELF_R_SYM ELF32_R_SYM
+#define DETOURING_ELF_R_TYPE ELF32_R_TYPE
+#define DETOURING_ELF_DT_RELOCATIONS DT_REL
+#define DETOURING_ELF_DT_RELOCATIONS_SIZE DT_RELSZ
+#define DETOURING_ELF_R_JUMP_SLOT R_386_JMP_SLOT
+#define DETOURING_ELF_R_GLOB_DAT R_386_GLOB_DAT
+
+typedef ElfW( Rel ) DETOURING_ELF_RELOCATION;
+
+#endif
+
+#endif
+
+namespace Detouring
+{
+	// Hash function used by DT_GNU_HASH tables
+	uint32_t GetGNUHash( const char *name );
+
+	// Extracts the NT_GNU_BUILD_ID descriptor from a block of ELF notes
+	bool GetBuildId( const void *notes, size_t size, std::string &build_id );
+
+#if defined SYSTEM_LINUX
+
+	// Pointers into the dynamic linking structures of a loaded module
+	struct DynamicInfo
+	{
+		std::string path;
+		uintptr_t base = 0;
+		const ElfW( Sym ) *symbols = nullptr;
+		const char *strings = nullptr;
+		size_t strings_size = 0;
+		const uint32_t *gnu_hash = nullptr;
+		const ElfW( Word ) *hash = nullptr;
+		const ElfW( Half ) *versions = nullptr;
+
+		// .rela.dyn (.rel.dyn on x86) and .rela.plt (.rel.plt)
+		const DETOURING_ELF_RELOCATION *relocations = nullptr;
+		size_t relocations_size = 0;
+		const DETOURING_ELF_RELOCATION *plt_relocations = nullptr;
+		size_t plt_relocations_size = 0;
+	};
+
+	bool GetDynamicInfo( const dl_phdr_info &phdr, DynamicInfo &info );
+	// For link maps, whose l_ld points to the dynamic section
+	bool GetDynamicInfo( uintptr_t base, const ElfW( Dyn ) *dynamic, DynamicInfo &info );
+
+	// Looks the name up in the module's DT_GNU_HASH (or DT_HASH) table
+	// Only default versions of defined symbols are returned
+	const ElfW( Sym ) *FindDynamicSymbol( const DynamicInfo &info, const char *name, uint32_t gnu_hash );
+
+	// Collects the GOT slots the module's JUMP_SLOT and GLOB_DAT relocations
+	// bind to the named symbol, returning how many were added
+	size_t FindImportSlots( const DynamicInfo &info, const char *name, std::vector<void **> &slots );
+
+#endif
+}
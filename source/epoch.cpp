@@ -0,0 +1,257 @@
+/*************************************************************************
+* Detouring::EpochGuard
+* Epoch based reclamation for the trampolines and gates of destroyed
+* hooks.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "epoch.hpp"
+#include "retire.hpp"
+#include "freeze.hpp"
+#include "MinHook.h"
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace Detouring
+{
+	namespace
+	{
+		struct alignas( 64 ) ThreadRecord
+		{
+			// Global epoch seen when the outermost guard was entered, zero outside guards
+			std::atomic<uint64_t> epoch = 0;
+			std::atomic<bool> in_use = true;
+			uint32_t depth = 0;
+			ThreadRecord *next = nullptr;
+		};
+
+		// How long creating a hook waits for a destroyed one on the same target
+		constexpr auto ReleaseTimeout = std::chrono::milliseconds( 100 );
+
+		struct RetiredHook
+		{
+			void *target;
+			Gate gate;
+			uint64_t epoch;
+		};
+
+		struct Epochs
+		{
+			std::atomic<uint64_t> global = 1;
+			std::atomic<ThreadRecord *> records = nullptr;
+			std::mutex retired_mutex;
+			std::vector<RetiredHook> retired;
+		};
+
+		// Never destroyed, since hooks with static storage duration are
+		// destroyed during exit
+		Epochs &GetEpochs( )
+		{
+			static Epochs *epochs = new Epochs( );
+			return *epochs;
+		}
+
+		// Records are reused once their thread exits and are never freed
+		ThreadRecord *AcquireRecord( )
+		{
+			Epochs &epochs = GetEpochs( );
+			for( ThreadRecord *record = epochs.records.load( std::memory_order_acquire ); record != nullptr; record = record->next )
+			{
+				bool in_use = false;
+				if( record->in_use.compare_exchange_strong( in_use, true, std::memory_order_acq_rel ) )
+					return record;
+			}
+
+			ThreadRecord *record = new ThreadRecord( );
+			record->next = epochs.records.load( std::memory_order_relaxed );
+			while( !epochs.records.compare_exchange_weak( record->next, record, std::memory_order_release ) );
+			return record;
+		}
+
+		struct ThreadRecordHolder
+		{
+			~ThreadRecordHolder( )
+			{
+				if( record == nullptr )
+					return;
+
+				record->depth = 0;
+				record->epoch.store( 0, std::memory_order_release );
+				record->in_use.store( false, std::memory_order_release );
+			}
+
+			ThreadRecord *record = nullptr;
+		};
+
+		ThreadRecord &GetThreadRecord( )
+		{
+			static thread_local ThreadRecordHolder holder;
+			if( holder.record == nullptr )
+				holder.record = AcquireRecord( );
+
+			return *holder.record;
+		}
+
+		// Oldest epoch still held by a guard, or the current one when there are none
+		uint64_t GetOldestActiveEpoch( )
+		{
+			Epochs &epochs = GetEpochs( );
+			uint64_t oldest = epochs.global.load( std::memory_order_seq_cst );
+			for( ThreadRecord *record = epochs.records.load( std::memory_order_acquire ); record != nullptr; record = record->next )
+			{
+				const uint64_t epoch = record->epoch.load( std::memory_order_seq_cst );
+				if( epoch != 0 && epoch < oldest )
+					oldest = epoch;
+			}
+
+			return oldest;
+		}
+
+		size_t ReleaseRetiredHooks( Epochs &epochs )
+		{
+			const uint64_t oldest = GetOldestActiveEpoch( );
+
+			size_t kept = 0;
+			for( RetiredHook &hook : epochs.retired )
+			{
+				// Guards entered after the hook was retired cannot reach it
+				if( hook.epoch < oldest )
+				{
+					{
+						std::lock_guard lock( GetMinHookMutex( ) );
+						MH_RemoveHook( hook.target );
+						MH_Uninitialize( );
+					}
+
+					FreeGate( hook.gate );
+				}
+				else
+					epochs.retired[kept++] = hook;
+			}
+
+			epochs.retired.resize( kept );
+			return kept;
+		}
+	}
+
+	EpochGuard::EpochGuard( )
+	{
+		ThreadRecord &record = GetThreadRecord( );
+		if( record.depth++ != 0 )
+			return;
+
+		// Republish until the epoch is stable so a concurrent reclaim either
+		// sees this guard or retired its hooks before the guard was entered
+		std::atomic<uint64_t> &global = GetEpochs( ).global;
+		uint64_t epoch = global.load( std::memory_order_seq_cst );
+		while( true )
+		{
+			record.epoch.store( epoch, std::memory_order_seq_cst );
+			const uint64_t current = global.load( std::memory_order_seq_cst );
+			if( current == epoch )
+				break;
+
+			epoch = current;
+		}
+	}
+
+	EpochGuard::~EpochGuard( )
+	{
+		ThreadRecord &record = GetThreadRecord( );
+		if( --record.depth == 0 )
+			record.epoch.store( 0, std::memory_order_release );
+	}
+
+	size_t ReclaimDestroyedHooks( bool wait )
+	{
+		Epochs &epochs = GetEpochs( );
+		wait = wait && GetThreadRecord( ).depth == 0;
+
+		std::unique_lock lock( epochs.retired_mutex );
+		size_t remaining = ReleaseRetiredHooks( epochs );
+		while( wait && remaining != 0 )
+		{
+			lock.unlock( );
+			std::this_thread::yield( );
+			lock.lock( );
+			remaining = ReleaseRetiredHooks( epochs );
+		}
+
+		return remaining;
+	}
+
+	bool ReleaseRetiredTarget( void *target )
+	{
+		Epochs &epochs = GetEpochs( );
+		const auto is_target = [target]( const RetiredHook &hook ) { return hook.target == target; };
+
+		std::unique_lock lock( epochs.retired_mutex );
+		if( std::none_of( epochs.retired.begin( ), epochs.retired.end( ), is_target ) )
+			return false;
+
+		// Guards held by this thread would never be released while waiting
+		const bool wait = GetThreadRecord( ).depth == 0;
+		const auto deadline = std::chrono::steady_clock::now( ) + ReleaseTimeout;
+		while( true )
+		{
+			ReleaseRetiredHooks( epochs );
+			if( std::none_of( epochs.retired.begin( ), epochs.retired.end( ), is_target ) )
+				return true;
+
+			if( !wait || std::chrono::steady_clock::now( ) >= deadline )
+				return false;
+
+			lock.unlock( );
+			std::this_thread::yield( );
+			lock.lock( );
+		}
+	}
+
+	void RetireHook( void *target, Gate &gate )
+	{
+		Epochs &epochs = GetEpochs( );
+
+		{
+			std::lock_guard lock( epochs.retired_mutex );
+			epochs.retired.push_back( { target, gate, epochs.global.fetch_add( 1, std::memory_order_seq_cst ) } );
+		}
+
+		gate = Gate( );
+		ReclaimDestroyedHooks( );
+	}
+}
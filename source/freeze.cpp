@@ -0,0 +1,519 @@
+/*************************************************************************
+* Detouring::ThreadFreeze
+* Internal thread stopping on Linux that parks every other thread in a
+* signal handler while code is patched.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "freeze.hpp"
+#include "platform.hpp"
+
+#if defined SYSTEM_LINUX && ( defined ARCHITECTURE_X86 || defined ARCHITECTURE_X86_64 )
+
+#define DETOURING_THREAD_FREEZE 1
+
+#include "hde.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#endif
+
+namespace Detouring
+{
+	std::mutex &GetMinHookMutex( )
+	{
+		// Never destroyed, since hooks with static storage duration are
+		// destroyed during exit
+		static std::mutex *mutex = new std::mutex( );
+		return *mutex;
+	}
+
+#if defined DETOURING_THREAD_FREEZE
+
+	namespace
+	{
+
+#if defined ARCHITECTURE_X86_64
+
+		typedef hde64s Instruction;
+
+		unsigned int Disassemble( const void *code, Instruction &instruction )
+		{
+			return hde64_disasm( code, &instruction );
+		}
+
+#else
+
+		typedef hde32s Instruction;
+
+		unsigned int Disassemble( const void *code, Instruction &instruction )
+		{
+			return hde32_disasm( code, &instruction );
+		}
+
+#endif
+
+		static constexpr size_t MaximumThreads = 4096;
+		static constexpr size_t MaximumAttempts = 16;
+		// Threads that are not blocking the signal only need to be scheduled
+		static constexpr std::chrono::microseconds StopTimeout( 2000 );
+		static constexpr std::chrono::microseconds StopTimeoutPerThread( 10 );
+		static constexpr timespec PollInterval = { 0, 100000 };
+
+		struct ParkedThread
+		{
+			std::atomic<pid_t> thread;
+			std::atomic<uintptr_t> instruction;
+
+			// Where the thread continues once released, zero to stay put
+			std::atomic<uintptr_t> destination;
+
+			// Number of the freeze the thread parked for, written last
+			std::atomic<int> freeze;
+		};
+
+		struct FreezeState
+		{
+			std::mutex mutex;
+			int signal = 0;
+
+			// Number of the current freeze and of the last one released,
+			// which is also the futex parked threads wait on
+			std::atomic<int> current = 0;
+			std::atomic<int> released = 0;
+
+			// Counts of threads that entered and left the handler, which are
+			// also the futexes freezing and releasing threads wait on
+			std::atomic<int> arrived = 0;
+			std::atomic<int> left = 0;
+
+			// Arrivals only wake the freezing thread once all are expected in
+			std::atomic<int> expected = 0;
+			ParkedThread parked[MaximumThreads];
+
+			pid_t signaled[MaximumThreads];
+			size_t signaled_count = 0;
+		};
+
+		// Set before the handler is installed, so it never runs a static
+		// initializer. Never destroyed, like the other internal registries.
+		FreezeState *freeze_state = nullptr;
+
+		// A thread signaled by a freeze that gave up may reserve a slot after
+		// the next freeze reset the count, then leave right away. Slots it
+		// (or an earlier freeze) wrote hold another freeze number.
+		bool IsParked( const FreezeState &state, const ParkedThread &parked )
+		{
+			return parked.freeze.load( std::memory_order_acquire ) == state.current.load( std::memory_order_relaxed );
+		}
+
+		long Futex( std::atomic<int> &word, int operation, int value, const timespec *timeout = nullptr )
+		{
+			return syscall( SYS_futex, reinterpret_cast<int *>( &word ), operation, value, timeout, nullptr, 0 );
+		}
+
+		size_t GetArrivedCount( const FreezeState &state )
+		{
+			return std::min( static_cast<size_t>( state.arrived.load( std::memory_order_acquire ) ), MaximumThreads );
+		}
+
+		void HandleFreeze( int, siginfo_t *, void *context )
+		{
+			FreezeState &state = *freeze_state;
+			const int error = errno;
+
+			// Signals left over from a freeze that gave up find it released
+			const int freeze = state.current.load( std::memory_order_acquire );
+			if( state.released.load( std::memory_order_acquire ) == freeze )
+				return;
+
+			ucontext_t *ucontext = static_cast<ucontext_t *>( context );
+
+#if defined ARCHITECTURE_X86_64
+
+			greg_t &instruction = ucontext->uc_mcontext.gregs[REG_RIP];
+
+#else
+
+			greg_t &instruction = ucontext->uc_mcontext.gregs[REG_EIP];
+
+#endif
+
+			const size_t index = static_cast<size_t>( state.arrived.fetch_add( 1, std::memory_order_acq_rel ) );
+			if( index < MaximumThreads )
+			{
+				ParkedThread &parked = state.parked[index];
+				parked.destination.store( 0, std::memory_order_relaxed );
+				parked.instruction.store( static_cast<uintptr_t>( instruction ), std::memory_order_relaxed );
+				parked.thread.store( static_cast<pid_t>( syscall( SYS_gettid ) ), std::memory_order_relaxed );
+				parked.freeze.store( freeze, std::memory_order_release );
+			}
+
+			if( static_cast<int>( index ) + 1 >= state.expected.load( std::memory_order_acquire ) )
+				Futex( state.arrived, FUTEX_WAKE_PRIVATE, 1 );
+
+			int released;
+			while( ( released = state.released.load( std::memory_order_acquire ) ) != freeze )
+				Futex( state.released, FUTEX_WAIT_PRIVATE, released );
+
+			if( index < MaximumThreads )
+			{
+				const uintptr_t destination = state.parked[index].destination.load( std::memory_order_acquire );
+				if( destination != 0 )
+					instruction = static_cast<greg_t>( destination );
+			}
+
+			state.left.fetch_add( 1, std::memory_order_release );
+			Futex( state.left, FUTEX_WAKE_PRIVATE, 1 );
+			errno = error;
+		}
+
+		FreezeState *GetFreezeState( )
+		{
+			static FreezeState *state = []( ) -> FreezeState *
+			{
+				freeze_state = new FreezeState( );
+
+				// Far from the low real time signals libraries usually take
+				struct sigaction action = { };
+				action.sa_sigaction = HandleFreeze;
+				action.sa_flags = SA_SIGINFO | SA_RESTART;
+				sigemptyset( &action.sa_mask );
+				if( sigaction( SIGRTMAX - 4, &action, nullptr ) != 0 )
+					return nullptr;
+
+				freeze_state->signal = SIGRTMAX - 4;
+				return freeze_state;
+			}( );
+			return state;
+		}
+
+		// Reads the task directory with getdents64, since opendir allocates
+		// and threads signaled by earlier passes may hold the allocator lock
+		bool SignalThreads( FreezeState &state, size_t &found )
+		{
+			const int directory = open( "/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+			if( directory < 0 )
+				return false;
+
+			const pid_t process = getpid( );
+			const pid_t self = static_cast<pid_t>( syscall( SYS_gettid ) );
+			bool success = true;
+			found = 0;
+
+			alignas( dirent64 ) char buffer[4096];
+			long length;
+			while( success && ( length = syscall( SYS_getdents64, directory, buffer, sizeof( buffer ) ) ) > 0 )
+				for( long offset = 0; success && offset < length; )
+				{
+					const dirent64 *entry = reinterpret_cast<const dirent64 *>( buffer + offset );
+					offset += entry->d_reclen;
+
+					const pid_t thread = static_cast<pid_t>( std::strtol( entry->d_name, nullptr, 10 ) );
+					if( thread <= 0 || thread == self )
+						continue;
+
+					const pid_t *begin = state.signaled, *end = begin + state.signaled_count;
+					if( std::find( begin, end, thread ) != end )
+						continue;
+
+					if( state.signaled_count == MaximumThreads )
+						success = false;
+					else if( syscall( SYS_tgkill, process, thread, state.signal ) == 0 )
+					{
+						state.signaled[state.signaled_count++] = thread;
+						state.expected.store( static_cast<int>( state.signaled_count ), std::memory_order_release );
+						++found;
+					}
+					else if( errno != ESRCH )
+						success = false;
+				}
+
+			close( directory );
+			return success && length == 0;
+		}
+
+		// Reads SigBlk from the thread's status without allocating
+		bool IsSignalBlocked( pid_t thread, int signal )
+		{
+			char path[64];
+			std::snprintf( path, sizeof( path ), "/proc/self/task/%d/status", static_cast<int>( thread ) );
+			const int status = open( path, O_RDONLY | O_CLOEXEC );
+			if( status < 0 )
+				return false;
+
+			char buffer[2048];
+			const ssize_t length = read( status, buffer, sizeof( buffer ) - 1 );
+			close( status );
+			if( length <= 0 )
+				return false;
+
+			buffer[length] = '\0';
+			const char *blocked = std::strstr( buffer, "SigBlk:" );
+			if( blocked == nullptr )
+				return false;
+
+			const unsigned long long mask = std::strtoull( blocked + 7, nullptr, 16 );
+			return ( mask >> ( signal - 1 ) & 1 ) != 0;
+		}
+
+		bool IsStopped( const FreezeState &state, pid_t thread )
+		{
+			const size_t arrived = GetArrivedCount( state );
+			for( size_t k = 0; k < arrived; ++k )
+				if( IsParked( state, state.parked[k] ) && state.parked[k].thread.load( std::memory_order_relaxed ) == thread )
+					return true;
+
+			// Threads that exited after being signaled never arrive
+			return syscall( SYS_tgkill, getpid( ), thread, 0 ) != 0 && errno == ESRCH;
+		}
+
+		// Sleeps on the arrival count instead of spinning, which leaves the
+		// cores to the threads that still have to reach the handler. Threads
+		// blocking the signal would never arrive, so finding one gives up
+		// right away instead of keeping the others stopped until the deadline.
+		bool WaitForThreads( FreezeState &state, std::chrono::steady_clock::time_point deadline )
+		{
+			bool timed_out = false;
+			while( true )
+			{
+				// Exited threads never arrive and only show up in the full check
+				const int arrived = state.arrived.load( std::memory_order_acquire );
+				if( static_cast<size_t>( arrived ) >= state.signaled_count || timed_out )
+				{
+					bool stopped = true;
+					for( size_t k = 0; k < state.signaled_count; ++k )
+						if( !IsStopped( state, state.signaled[k] ) )
+						{
+							if( IsSignalBlocked( state.signaled[k], state.signal ) )
+								return false;
+
+							stopped = false;
+						}
+
+					if( stopped )
+						return true;
+				}
+
+				if( std::chrono::steady_clock::now( ) >= deadline )
+					return false;
+
+				timed_out = Futex( state.arrived, FUTEX_WAIT_PRIVATE, arrived, &PollInterval ) != 0 && errno == ETIMEDOUT;
+			}
+		}
+
+		// Threads may start while others are being signaled, so the task
+		// directory is read again until it has no unsignaled threads left
+		bool StopThreads( FreezeState &state )
+		{
+			const auto start = std::chrono::steady_clock::now( );
+			while( true )
+			{
+				size_t found = 0;
+				if( !SignalThreads( state, found ) )
+					return false;
+
+				if( found == 0 )
+					return true;
+
+				const auto deadline = start + StopTimeout + StopTimeoutPerThread * state.signaled_count;
+				if( !WaitForThreads( state, deadline ) )
+					return false;
+			}
+		}
+
+		void ReleaseThreads( FreezeState &state )
+		{
+			state.released.store( state.current.load( std::memory_order_relaxed ), std::memory_order_release );
+			Futex( state.released, FUTEX_WAKE_PRIVATE, INT_MAX );
+
+			// Parked threads read their slots until they leave the handler
+			int left;
+			while( ( left = state.left.load( std::memory_order_acquire ) ) < state.arrived.load( std::memory_order_acquire ) )
+				Futex( state.left, FUTEX_WAIT_PRIVATE, left, &PollInterval );
+		}
+
+		// MinHook copies instructions into the trampoline unchanged until the
+		// first relative branch or return, so up to there an offset into the
+		// code is also the offset of the same instruction in the trampoline
+		bool IsRelocatable( const FrozenCode &code, size_t offset )
+		{
+			uint8_t bytes[32] = { };
+			std::memcpy( bytes, code.original, std::min<size_t>( code.size, 16 ) );
+
+			size_t position = 0;
+			while( position < offset )
+			{
+				Instruction instruction;
+				const unsigned int length = Disassemble( bytes + position, instruction );
+				if(
+					length == 0 ||
+					( instruction.flags & ( F_ERROR | F_RELATIVE ) ) != 0 ||
+					instruction.opcode == 0xC2 || instruction.opcode == 0xC3
+				)
+					return false;
+
+				position += length;
+			}
+
+			return position == offset;
+		}
+
+		// Offset of the instruction pointer inside the code, past its start,
+		// or zero when it is elsewhere
+		size_t GetInteriorOffset( const FrozenCode &code, uintptr_t instruction )
+		{
+			const uintptr_t address = reinterpret_cast<uintptr_t>( code.address );
+			return instruction > address && instruction - address < code.size ? instruction - address : 0;
+		}
+
+		bool CanRelocateThreads( const FreezeState &state, const FrozenCode *code, size_t count )
+		{
+			const size_t arrived = GetArrivedCount( state );
+			for( size_t k = 0; k < arrived; ++k )
+			{
+				if( !IsParked( state, state.parked[k] ) )
+					continue;
+
+				const uintptr_t instruction = state.parked[k].instruction.load( std::memory_order_relaxed );
+				for( size_t i = 0; i < count; ++i )
+				{
+					const size_t offset = GetInteriorOffset( code[i], instruction );
+					if( offset != 0 && !IsRelocatable( code[i], offset ) )
+						return false;
+				}
+			}
+
+			return true;
+		}
+	}
+
+	ThreadFreeze::~ThreadFreeze( )
+	{
+		Release( );
+	}
+
+	bool ThreadFreeze::Freeze( const FrozenCode *code, size_t count )
+	{
+		FreezeState *state = GetFreezeState( );
+		if( state == nullptr || lock.owns_lock( ) )
+			return false;
+
+		lock = std::unique_lock( state->mutex );
+		for( size_t attempt = 0; attempt < MaximumAttempts; ++attempt )
+		{
+			// Gives threads caught in the middle of the code time to leave it
+			if( attempt != 0 )
+				std::this_thread::yield( );
+
+			state->arrived.store( 0, std::memory_order_relaxed );
+			state->left.store( 0, std::memory_order_relaxed );
+			state->signaled_count = 0;
+			state->expected.store( 0, std::memory_order_relaxed );
+			state->current.fetch_add( 1, std::memory_order_release );
+
+			const bool stopped = StopThreads( *state );
+			if( stopped && CanRelocateThreads( *state, code, count ) )
+				return true;
+
+			ReleaseThreads( *state );
+			if( !stopped )
+				break;
+		}
+
+		lock.unlock( );
+		return false;
+	}
+
+	void ThreadFreeze::Release( )
+	{
+		if( !lock.owns_lock( ) )
+			return;
+
+		ReleaseThreads( *freeze_state );
+		lock.unlock( );
+	}
+
+	void ThreadFreeze::RelocateThreads( const FrozenCode &code, const void *trampoline )
+	{
+		if( !lock.owns_lock( ) )
+			return;
+
+		FreezeState &state = *freeze_state;
+		const size_t arrived = GetArrivedCount( state );
+		for( size_t k = 0; k < arrived; ++k )
+		{
+			ParkedThread &parked = state.parked[k];
+			if( !IsParked( state, parked ) )
+				continue;
+
+			const size_t offset = GetInteriorOffset( code, parked.instruction.load( std::memory_order_relaxed ) );
+			if( offset != 0 && IsRelocatable( code, offset ) )
+				parked.destination.store( reinterpret_cast<uintptr_t>( trampoline ) + offset, std::memory_order_release );
+		}
+	}
+
+#else
+
+	ThreadFreeze::~ThreadFreeze( )
+	{ }
+
+	bool ThreadFreeze::Freeze( const FrozenCode *, size_t )
+	{
+		return true;
+	}
+
+	void ThreadFreeze::Release( )
+	{ }
+
+	void ThreadFreeze::RelocateThreads( const FrozenCode &, const void * )
+	{ }
+
+#endif
+
+}
@@ -0,0 +1,84 @@
+/*************************************************************************
+* Detouring::ThreadFreeze
+* Internal thread stopping on Linux that parks every other thread in a
+* signal handler while code is patched.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+namespace Detouring
+{
+	// Held around every MinHook call, and taken before Freeze by callers
+	// that call MinHook while threads are stopped, so no stopped thread can
+	// be inside MinHook holding its spinlock or allocations it makes
+	std::mutex &GetMinHookMutex( );
+
+	// Code about to be patched, with the bytes it holds before the patch
+	struct FrozenCode
+	{
+		const void *address;
+		const uint8_t *original;
+		size_t size;
+	};
+
+	// Stops every other thread by parking it in a signal handler on Linux.
+	// Elsewhere MinHook suspends threads itself, so freezing does nothing.
+	// Threads may hold any lock while stopped, so nothing between Freeze and
+	// Release may allocate or lock anything other threads could hold.
+	class ThreadFreeze
+	{
+	public:
+		ThreadFreeze( ) = default;
+		ThreadFreeze( const ThreadFreeze & ) = delete;
+		ThreadFreeze &operator=( const ThreadFreeze & ) = delete;
+		~ThreadFreeze( );
+
+		// Retries while a thread is stopped in the middle of the code on an
+		// instruction RelocateThreads cannot move. Fails when that keeps
+		// happening or some thread does not stop in time, e.g. because it
+		// blocks the signal, in which case every thread is running again.
+		bool Freeze( const FrozenCode *code, size_t count );
+		void Release( );
+
+		// Threads stopped in the middle of the code continue at the matching
+		// instruction of its trampoline once released
+		void RelocateThreads( const FrozenCode &code, const void *trampoline );
+
+	private:
+		std::unique_lock<std::mutex> lock;
+	};
+}
@@ -0,0 +1,182 @@
+/*************************************************************************
+* Detouring::Gate
+* Internal indirect jump thunks whose destination is a pointer that can
+* be swapped atomically.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "gate.hpp"
+#include "helpers.hpp"
+#include "platform.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#if defined SYSTEM_WINDOWS
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+
+#elif defined SYSTEM_POSIX
+
+#include <sys/mman.h>
+
+#endif
+
+namespace Detouring
+{
+	namespace
+	{
+		constexpr size_t GateCodeSize = 8;
+
+		struct GateBlock
+		{
+			uint8_t *code;
+			std::atomic<void *> *slots;
+		};
+
+		struct GatePool
+		{
+			std::mutex mutex;
+			std::vector<Gate> free_gates;
+		};
+
+		GatePool &GetGatePool( )
+		{
+			static GatePool *pool = new GatePool( );
+			return *pool;
+		}
+
+		// One page of thunks followed by one page of slots, thunk k jumping through slot k
+		bool AllocateBlock( GatePool &pool )
+		{
+			const size_t page_size = GetPageSize( );
+
+#if defined SYSTEM_WINDOWS
+
+			void *memory = VirtualAlloc( nullptr, page_size * 2, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+			if( memory == nullptr )
+				return false;
+
+#elif defined SYSTEM_POSIX
+
+			void *memory = mmap( nullptr, page_size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+			if( memory == MAP_FAILED )
+				return false;
+
+#endif
+
+			GateBlock block;
+			block.code = static_cast<uint8_t *>( memory );
+			block.slots = reinterpret_cast<std::atomic<void *> *>( block.code + page_size );
+
+			const size_t count = page_size / GateCodeSize;
+			for( size_t k = 0; k < count; ++k )
+			{
+				uint8_t *code = block.code + k * GateCodeSize;
+				std::atomic<void *> *slot = new( &block.slots[k] ) std::atomic<void *>( nullptr );
+
+#if defined ARCHITECTURE_X86_64
+
+				// jmp qword ptr [rip + displacement]
+				const int32_t displacement = static_cast<int32_t>(
+					reinterpret_cast<intptr_t>( slot ) - reinterpret_cast<intptr_t>( code + 6 )
+				);
+
+#else
+
+				// jmp dword ptr [slot]
+				const int32_t displacement = static_cast<int32_t>( reinterpret_cast<intptr_t>( slot ) );
+
+#endif
+
+				code[0] = 0xFF;
+				code[1] = 0x25;
+				std::memcpy( code + 2, &displacement, sizeof( displacement ) );
+				code[6] = 0xCC;
+				code[7] = 0xCC;
+			}
+
+			if( !SetMemoryProtection( block.code, page_size, MemoryProtection::Read | MemoryProtection::Execute ) )
+			{
+
+#if defined SYSTEM_WINDOWS
+
+				VirtualFree( memory, 0, MEM_RELEASE );
+
+#elif defined SYSTEM_POSIX
+
+				munmap( memory, page_size * 2 );
+
+#endif
+
+				return false;
+			}
+
+			for( size_t k = count; k > 0; --k )
+				pool.free_gates.push_back( { block.code + ( k - 1 ) * GateCodeSize, &block.slots[k - 1] } );
+
+			return true;
+		}
+	}
+
+	bool AllocateGate( Gate &gate, void *destination )
+	{
+		GatePool &pool = GetGatePool( );
+		std::lock_guard lock( pool.mutex );
+
+		if( pool.free_gates.empty( ) && !AllocateBlock( pool ) )
+			return false;
+
+		gate = pool.free_gates.back( );
+		pool.free_gates.pop_back( );
+		gate.slot->store( destination, std::memory_order_release );
+		return true;
+	}
+
+	void FreeGate( Gate &gate )
+	{
+		if( gate.code == nullptr )
+			return;
+
+		GatePool &pool = GetGatePool( );
+		std::lock_guard lock( pool.mutex );
+
+		gate.slot->store( nullptr, std::memory_order_release );
+		pool.free_gates.push_back( gate );
+		gate = Gate( );
+	}
+}
@@ -37,7 +37,10 @@
 #include "platform.hpp"
 #include "MinHook.h"
 #include <stdexcept>
+#include <cstring>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #if defined SYSTEM_WINDOWS
 
@@ -52,8 +55,12 @@
 
 #include <sys/mman.h>
 #include <unistd.h>
-#include <cstdio>
-#include <cinttypes>
+#include <fcntl.h>
+#include <link.h>
+#include <cerrno>
+#include <string>
+#include <mutex>
+#include <shared_mutex>
 
 #elif defined SYSTEM_MACOSX
 
@@ -66,6 +73,282 @@
 
 namespace Detouring
 {
+
+#if defined SYSTEM_LINUX
+
+	// Snapshot of /proc/self/maps, sorted by address so lookups are a binary
+	// search. Protection changes made through SetMemoryProtection are applied
+	// in place. Single address hits are answered without any system call, so
+	// they are only as fresh as the snapshot. It is rebuilt when a missing
+	// address is mapped, when a batch query sees the link map changed (modules
+	// loaded or unloaded since) and before WritableScope changes protections.
+	class MemoryMap
+	{
+	public:
+		static MemoryMap &GetInstance( )
+		{
+			static MemoryMap memory_map;
+			return memory_map;
+		}
+
+		bool Refresh( )
+		{
+			// Read first, so a module loaded while parsing is noticed later
+			const unsigned long long generation = GetLinkGeneration( );
+
+			std::vector<MemoryRegion> snapshot;
+			if( !Parse( snapshot ) )
+				return false;
+
+			std::unique_lock lock( mutex );
+			regions = std::move( snapshot );
+			link_generation = generation;
+			return true;
+		}
+
+		bool GetRegion( uintptr_t address, MemoryRegion &region )
+		{
+			{
+				std::shared_lock lock( mutex );
+				const MemoryRegion *found = Find( address );
+				if( found != nullptr )
+				{
+					region = *found;
+					return true;
+				}
+			}
+
+			// Nothing new to find for an address the kernel does not map
+			if( !IsMapped( address ) )
+				return false;
+
+			if( !Refresh( ) )
+				return false;
+
+			std::shared_lock lock( mutex );
+			const MemoryRegion *found = Find( address );
+			if( found == nullptr )
+				return false;
+
+			region = *found;
+			return true;
+		}
+
+		// The order must sort the addresses in ascending order
+		bool GetProtections(
+			void *const *addresses,
+			const std::vector<size_t> &order,
+			int32_t *protections
+		)
+		{
+			const unsigned long long generation = GetLinkGeneration( );
+			bool found = false;
+			{
+				std::shared_lock lock( mutex );
+				if( generation == link_generation && Merge( addresses, order, protections, true, found ) )
+					return found;
+			}
+
+			if( !Refresh( ) )
+				return false;
+
+			std::shared_lock lock( mutex );
+			Merge( addresses, order, protections, false, found );
+			return found;
+		}
+
+		void Update( uintptr_t start, uintptr_t end, int32_t protection )
+		{
+			std::unique_lock lock( mutex );
+
+			std::vector<MemoryRegion> updated;
+			updated.reserve( regions.size( ) + 2 );
+			for( const MemoryRegion &region : regions )
+			{
+				if( region.end <= start || region.start >= end )
+				{
+					updated.push_back( region );
+					continue;
+				}
+
+				if( region.start < start )
+					updated.push_back( { region.start, start, region.protection } );
+
+				if( region.end > end )
+					updated.push_back( { end, region.end, region.protection } );
+			}
+
+			const auto it = std::lower_bound(
+				updated.begin( ),
+				updated.end( ),
+				start,
+				[]( const MemoryRegion &region, uintptr_t value ) { return region.start < value; }
+			);
+			updated.insert( it, { start, end, protection } );
+			regions = std::move( updated );
+		}
+
+	private:
+		MemoryMap( ) = default;
+
+		// Walks the sorted addresses and the regions together. When validating,
+		// returns false as soon as a missing address turns out to be mapped,
+		// since the snapshot needs a rebuild then. Hits are trusted, as the
+		// caller already checked the link generation for the whole batch.
+		bool Merge(
+			void *const *addresses,
+			const std::vector<size_t> &order,
+			int32_t *protections,
+			bool validate,
+			bool &found
+		) const
+		{
+			found = true;
+			auto it = regions.begin( );
+			for( const size_t k : order )
+			{
+				const uintptr_t address = reinterpret_cast<uintptr_t>( addresses[k] );
+				while( it != regions.end( ) && it->end <= address )
+					++it;
+
+				if( it == regions.end( ) || address < it->start )
+				{
+					if( validate && IsMapped( address ) )
+						return false;
+
+					protections[k] = MemoryProtection::Error;
+					found = false;
+					continue;
+				}
+
+				protections[k] = it->protection;
+			}
+
+			return true;
+		}
+
+		const MemoryRegion *Find( uintptr_t address ) const
+		{
+			const auto it = std::upper_bound(
+				regions.begin( ),
+				regions.end( ),
+				address,
+				[]( uintptr_t value, const MemoryRegion &region ) { return value < region.end; }
+			);
+			if( it == regions.end( ) || address < it->start )
+				return nullptr;
+
+			return &*it;
+		}
+
+		static int ReadLinkGeneration( dl_phdr_info *phdr, size_t size, void *data )
+		{
+			if( size >= offsetof( dl_phdr_info, dlpi_subs ) + sizeof( phdr->dlpi_subs ) )
+				*static_cast<unsigned long long *>( data ) = phdr->dlpi_adds + phdr->dlpi_subs;
+
+			return 1;
+		}
+
+		// Changes whenever a module is loaded or unloaded
+		static unsigned long long GetLinkGeneration( )
+		{
+			unsigned long long generation = 0;
+			dl_iterate_phdr( ReadLinkGeneration, &generation );
+			return generation;
+		}
+
+		// msync fails with ENOMEM only for pages that are not mapped
+		static bool IsMapped( uintptr_t address )
+		{
+			const uintptr_t page_size = GetPageSize( );
+			void *page = reinterpret_cast<void *>( address / page_size * page_size );
+			return msync( page, page_size, MS_ASYNC ) == 0 || errno != ENOMEM;
+		}
+
+		static bool ParseHexadecimal( const char *&cursor, const char *end, uintptr_t &value )
+		{
+			const char *begin = cursor;
+			value = 0;
+			for( ; cursor != end; ++cursor )
+			{
+				const char c = *cursor;
+				if( c >= '0' && c <= '9' )
+					value = ( value << 4 ) | static_cast<uintptr_t>( c - '0' );
+				else if( c >= 'a' && c <= 'f' )
+					value = ( value << 4 ) | static_cast<uintptr_t>( c - 'a' + 10 );
+				else
+					break;
+			}
+
+			return cursor != begin;
+		}
+
+		static bool Parse( std::vector<MemoryRegion> &snapshot )
+		{
+			const int fd = open( "/proc/self/maps", O_RDONLY | O_CLOEXEC );
+			if( fd == -1 )
+				return false;
+
+			std::string contents;
+			char buffer[16384];
+			ssize_t count = 0;
+			while( ( count = read( fd, buffer, sizeof( buffer ) ) ) != 0 )
+			{
+				if( count > 0 )
+					contents.append( buffer, static_cast<size_t>( count ) );
+				else if( errno != EINTR )
+					break;
+			}
+
+			close( fd );
+
+			const char *cursor = contents.data( ), *end = cursor + contents.size( );
+			while( cursor < end )
+			{
+				const char *line_end = std::find( cursor, end, '\n' );
+
+				uintptr_t start = 0, stop = 0;
+				if(
+					ParseHexadecimal( cursor, line_end, start ) &&
+					cursor != line_end && *cursor++ == '-' &&
+					ParseHexadecimal( cursor, line_end, stop ) &&
+					line_end - cursor >= 4 && *cursor++ == ' '
+				)
+				{
+					int32_t protection = MemoryProtection::None;
+
+					if( cursor[0] == 'r' )
+						protection |= MemoryProtection::Read;
+
+					if( cursor[1] == 'w' )
+						protection |= MemoryProtection::Write;
+
+					if( cursor[2] == 'x' )
+						protection |= MemoryProtection::Execute;
+
+					if(
+						!snapshot.empty( ) &&
+						snapshot.back( ).end == start &&
+						snapshot.back( ).protection == protection
+					)
+						snapshot.back( ).end = stop;
+					else
+						snapshot.push_back( { start, stop, protection } );
+				}
+
+				cursor = line_end != end ? line_end + 1 : end;
+			}
+
+			return !snapshot.empty( );
+		}
+
+		std::shared_mutex mutex;
+		std::vector<MemoryRegion> regions;
+		unsigned long long link_generation = 0;
+	};
+
+#endif
+
 	Member::Member( )
 	{
 		address = nullptr;
@@ -83,36 +366,37 @@ namespace Detouring
 		return address != nullptr;
 	}
 
-	int32_t GetMemoryProtection( void *address )
+	bool GetMemoryRegion( void *address, MemoryRegion &region )
 	{
 		if( address == nullptr )
-			return MemoryProtection::Error;
+			return false;
 
 #if defined SYSTEM_WINDOWS
 
 		MEMORY_BASIC_INFORMATION mi = { 0 };
-		if( VirtualQuery( address, &mi, sizeof( mi ) ) != 0 && mi.State == MEM_COMMIT )
-		{
-			int32_t oldprotection = MemoryProtection::Unknown;
-
-			if( ( mi.Protect & PAGE_NOACCESS ) != 0 )
-				oldprotection = MemoryProtection::None;
-			else if( ( mi.Protect & PAGE_READONLY ) != 0 )
-				oldprotection = MemoryProtection::Read;
-			else if( ( mi.Protect & ( PAGE_READWRITE | PAGE_WRITECOPY ) ) != 0 )
-				oldprotection = MemoryProtection::Read | MemoryProtection::Write;
-			else if( ( mi.Protect & PAGE_EXECUTE ) != 0 )
-				oldprotection = MemoryProtection::Execute;
-			else if( ( mi.Protect & PAGE_EXECUTE_READ ) != 0 )
-				oldprotection = MemoryProtection::Read | MemoryProtection::Execute;
-			else if( ( mi.Protect & ( PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY ) ) != 0 )
-				oldprotection =
-					MemoryProtection::Read | MemoryProtection::Write | MemoryProtection::Execute;
-
-			return oldprotection;
-		}
+		if( VirtualQuery( address, &mi, sizeof( mi ) ) == 0 || mi.State != MEM_COMMIT )
+			return false;
 
-		return MemoryProtection::Error;
+		int32_t oldprotection = MemoryProtection::Unknown;
+
+		if( ( mi.Protect & PAGE_NOACCESS ) != 0 )
+			oldprotection = MemoryProtection::None;
+		else if( ( mi.Protect & PAGE_READONLY ) != 0 )
+			oldprotection = MemoryProtection::Read;
+		else if( ( mi.Protect & ( PAGE_READWRITE | PAGE_WRITECOPY ) ) != 0 )
+			oldprotection = MemoryProtection::Read | MemoryProtection::Write;
+		else if( ( mi.Protect & PAGE_EXECUTE ) != 0 )
+			oldprotection = MemoryProtection::Execute;
+		else if( ( mi.Protect & PAGE_EXECUTE_READ ) != 0 )
+			oldprotection = MemoryProtection::Read | MemoryProtection::Execute;
+		else if( ( mi.Protect & ( PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY ) ) != 0 )
+			oldprotection =
+				MemoryProtection::Read | MemoryProtection::Write | MemoryProtection::Execute;
+
+		region.start = reinterpret_cast<uintptr_t>( mi.BaseAddress );
+		region.end = region.start + mi.RegionSize;
+		region.protection = oldprotection;
+		return true;
 
 #elif defined SYSTEM_MACOSX
 
@@ -143,60 +427,76 @@ namespace Detouring
 			&object
 		);
 
-		if( status == KERN_SUCCESS )
-		{
-			int32_t oldprotection = MemoryProtection::None;
+		// mach_vm_region returns the next mapped region when the address is not mapped
+		if( status != KERN_SUCCESS || _address > reinterpret_cast<mach_vm_address_t>( address ) )
+			return false;
 
-			if( ( info.protection & VM_PROT_READ ) != 0 )
-				oldprotection |= MemoryProtection::Read;
+		int32_t oldprotection = MemoryProtection::None;
 
-			if( ( info.protection & VM_PROT_WRITE ) != 0 )
-				oldprotection |= MemoryProtection::Write;
+		if( ( info.protection & VM_PROT_READ ) != 0 )
+			oldprotection |= MemoryProtection::Read;
 
-			if( ( info.protection & VM_PROT_EXECUTE ) != 0 )
-				oldprotection |= MemoryProtection::Execute;
+		if( ( info.protection & VM_PROT_WRITE ) != 0 )
+			oldprotection |= MemoryProtection::Write;
 
-			return oldprotection;
-		}
+		if( ( info.protection & VM_PROT_EXECUTE ) != 0 )
+			oldprotection |= MemoryProtection::Execute;
 
-		return MemoryProtection::Error;
+		region.start = static_cast<uintptr_t>( _address );
+		region.end = static_cast<uintptr_t>( _address + vmsize );
+		region.protection = oldprotection;
+		return true;
 
 #else
 
-		FILE *file = fopen( "/proc/self/maps", "r" );
-		if( file == nullptr )
+		return MemoryMap::GetInstance( ).GetRegion( reinterpret_cast<uintptr_t>( address ), region );
+
+#endif
+
+	}
+
+	int32_t GetMemoryProtection( void *address )
+	{
+		MemoryRegion region;
+		if( !GetMemoryRegion( address, region ) )
 			return MemoryProtection::Error;
 
-		uintptr_t _address = reinterpret_cast<uintptr_t>( address );
-		char line[BUFSIZ] = { 0 };
-		while( fgets( line, sizeof( line ), file ) != nullptr )
+		return region.protection;
+	}
+
+	bool GetMemoryProtection( void *const *addresses, size_t count, int32_t *protections )
+	{
+		if( addresses == nullptr || protections == nullptr )
+			return false;
+
+		std::vector<size_t> order( count );
+		for( size_t k = 0; k < count; ++k )
+			order[k] = k;
+
+		std::sort( order.begin( ), order.end( ), [addresses]( size_t lhs, size_t rhs )
 		{
-			uint64_t start = 0, end = 0;
-			char prot[5] = { 0 };
-			if( sscanf( line, "%" SCNx64 "-%" SCNx64 " %4[rwxsp-]", &start, &end, prot ) == 3 &&
-				start <= _address &&
-				end >= _address )
-			{
-				fclose( file );
+			return reinterpret_cast<uintptr_t>( addresses[lhs] ) < reinterpret_cast<uintptr_t>( addresses[rhs] );
+		} );
 
-				int32_t oldprotection = MemoryProtection::None;
+#if defined SYSTEM_LINUX
 
-				if( prot[0] == 'r' )
-					oldprotection |= MemoryProtection::Read;
+		return MemoryMap::GetInstance( ).GetProtections( addresses, order, protections );
 
-				if( prot[1] == 'w' )
-					oldprotection |= MemoryProtection::Write;
+#else
 
-				if( prot[2] == 'x' )
-					oldprotection |= MemoryProtection::Execute;
+		bool found = true, valid = false;
+		MemoryRegion region;
+		for( const size_t k : order )
+		{
+			const uintptr_t address = reinterpret_cast<uintptr_t>( addresses[k] );
+			if( !valid || address < region.start || address >= region.end )
+				valid = GetMemoryRegion( addresses[k], region );
 
-				return oldprotection;
-			}
+			protections[k] = valid ? region.protection : MemoryProtection::Error;
+			found = found && valid;
 		}
 
-		fclose( file );
-
-		return MemoryProtection::Error;
+		return found;
 
 #endif
 
@@ -284,15 +584,42 @@ namespace Detouring
 		if( ( protection & MemoryProtection::Execute ) != 0 )
 			_protection |= PROT_EXEC;
 
+		const uintptr_t page_size = GetPageSize( );
 		uintptr_t _address = reinterpret_cast<uintptr_t>( address ),
-			diff = _address % static_cast<uintptr_t>( sysconf( _SC_PAGESIZE ) );
+			diff = _address % page_size;
 		address = reinterpret_cast<void *>( _address - diff );
-		return mprotect( address, diff + length, _protection ) == 0;
+		if( mprotect( address, diff + length, _protection ) != 0 )
+			return false;
+
+		const uintptr_t end = ( _address + length + page_size - 1 ) / page_size * page_size;
+		MemoryMap::GetInstance( ).Update( _address - diff, end, protection );
+		return true;
 
 #endif
 
 	}
 
+	size_t GetPageSize( )
+	{
+
+#if defined SYSTEM_WINDOWS
+
+		static const size_t page_size = []( )
+		{
+			SYSTEM_INFO info;
+			GetSystemInfo( &info );
+			return static_cast<size_t>( info.dwPageSize );
+		}( );
+
+#else
+
+		static const size_t page_size = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+
+#endif
+
+		return page_size;
+	}
+
 	bool ProtectMemory( void *address, size_t length, bool protect )
 	{
 		return SetMemoryProtection(
@@ -304,6 +631,169 @@ namespace Detouring
 		);
 	}
 
+	bool WriteProtectedMemory( void *address, const void *data, size_t length )
+	{
+		// A live pointer (a virtual table entry, say) must never be seen half
+		// written. The kernel copies an aligned word with a single store, so it
+		// goes through /proc/self/mem as one write, and through a single
+		// pointer store in the fallback.
+		const bool pointer =
+			length == sizeof( void * ) && reinterpret_cast<uintptr_t>( address ) % sizeof( void * ) == 0;
+
+#if defined SYSTEM_LINUX
+
+		// Kept open for the lifetime of the process, -1 if it can't be opened
+		static const int memory = open( "/proc/self/mem", O_RDWR | O_CLOEXEC );
+		if( memory != -1 )
+		{
+			const uint8_t *bytes = static_cast<const uint8_t *>( data );
+			// 64-bit offsets, since addresses above 2 GiB are negative 32-bit ones
+			off64_t offset = static_cast<off64_t>( reinterpret_cast<uintptr_t>( address ) );
+			size_t remaining = length;
+			while( remaining != 0 )
+			{
+				const ssize_t written = pwrite64( memory, bytes, remaining, offset );
+				if( written <= 0 || ( pointer && static_cast<size_t>( written ) != length ) )
+				{
+					if( written < 0 && errno == EINTR )
+						continue;
+
+					break;
+				}
+
+				bytes += written;
+				offset += written;
+				remaining -= static_cast<size_t>( written );
+			}
+
+			// The fallback rewrites whatever was already written, unchanged
+			if( remaining == 0 )
+				return true;
+		}
+
+#endif
+
+		WritableScope scope;
+		scope.Add( address, length );
+		if( !scope.Apply( ) )
+			return false;
+
+		if( pointer )
+		{
+			void *value = nullptr;
+			std::memcpy( &value, data, sizeof( void * ) );
+			*static_cast<void *volatile *>( address ) = value;
+		}
+		else
+			std::memcpy( address, data, length );
+
+		return true;
+	}
+
+	WritableScope::WritableScope( void *address, size_t length )
+	{
+		Add( address, length );
+		Apply( );
+	}
+
+	WritableScope::~WritableScope( )
+	{
+		Restore( );
+	}
+
+	void WritableScope::Add( void *address, size_t length )
+	{
+		if( address == nullptr || length == 0 )
+			return;
+
+		const uintptr_t page_size = GetPageSize( );
+		const uintptr_t start = reinterpret_cast<uintptr_t>( address );
+		pending.push_back( {
+			start / page_size * page_size,
+			( start + length + page_size - 1 ) / page_size * page_size,
+			MemoryProtection::Unknown
+		} );
+	}
+
+	bool WritableScope::Apply( )
+	{
+		std::sort( pending.begin( ), pending.end( ), []( const Range &a, const Range &b )
+		{
+			return a.start < b.start;
+		} );
+
+		size_t merged = 0;
+		for( size_t k = 1; k < pending.size( ); ++k )
+			if( pending[k].start <= pending[merged].end )
+				pending[merged].end = std::max( pending[merged].end, pending[k].end );
+			else
+				pending[++merged] = pending[k];
+
+		if( pending.empty( ) )
+			return true;
+
+		pending.resize( merged + 1 );
+
+		// The protection restored later must be the one the pages have now,
+		// not what the cached map last saw
+		RefreshMemoryMap( );
+
+		// Pages made writable by an earlier Apply already report Write and
+		// keep the protection recorded back then
+		bool success = true;
+		for( const Range &range : pending )
+			for( uintptr_t address = range.start; address < range.end; )
+			{
+				MemoryRegion region;
+				if( !GetMemoryRegion( reinterpret_cast<void *>( address ), region ) || region.protection < 0 )
+				{
+					success = false;
+					break;
+				}
+
+				const uintptr_t end = std::min( range.end, region.end );
+				if( ( region.protection & MemoryProtection::Write ) == 0 )
+				{
+					if( SetMemoryProtection(
+						reinterpret_cast<void *>( address ),
+						end - address,
+						region.protection | MemoryProtection::Write
+					) )
+						changed.push_back( { address, end, region.protection } );
+					else
+						success = false;
+				}
+
+				address = end;
+			}
+
+		pending.clear( );
+		return success;
+	}
+
+	void WritableScope::Restore( )
+	{
+		for( auto it = changed.rbegin( ); it != changed.rend( ); ++it )
+			SetMemoryProtection( reinterpret_cast<void *>( it->start ), it->end - it->start, it->protection );
+
+		changed.clear( );
+	}
+
+	bool RefreshMemoryMap( )
+	{
+
+#if defined SYSTEM_LINUX
+
+		return MemoryMap::GetInstance( ).Refresh( );
+
+#else
+
+		return true;
+
+#endif
+
+	}
+
 	bool IsExecutableAddress( void *address )
 	{
 		return ( GetMemoryProtection( address ) & MemoryProtection::Execute ) != 0;
@@ -34,11 +34,20 @@
 *************************************************************************/
 
 #include "hook.hpp"
+#include "registry.hpp"
+#include "gate.hpp"
+#include "retire.hpp"
+#include "deferred.hpp"
+#include "loader.hpp"
+#include "commit.hpp"
+#include "freeze.hpp"
+#include "symbols.hpp"
 #include "helpers.hpp"
 #include "platform.hpp"
 #include "MinHook.h"
 
 #include <cstring>
+#include <mutex>
 
 #if defined SYSTEM_WINDOWS
 
@@ -60,6 +69,40 @@
 
 namespace Detouring
 {
+	// Hard hooks go through MinHook until their patched code is recorded on
+	// the first enable, and are toggled by CommitHookCode afterwards
+	static bool SetHookCode( void *target, void *trampoline, bool enable )
+	{
+		if( HasHookCode( target ) )
+		{
+			const HookCodeChange change = { target, enable };
+			return CommitHookCode( &change, 1 );
+		}
+
+		std::lock_guard lock( GetMinHookMutex( ) );
+		if( !enable )
+			return MH_DisableHook( target ) == MH_OK;
+
+		uint8_t original[HookCodeSize];
+		ReadHookCode( target, original );
+
+		// Threads caught inside the jump continue in the trampoline. When
+		// they cannot be stopped, MinHook patches them running as before.
+		// The MinHook mutex is held first, so none of them is inside MinHook.
+		ThreadFreeze freeze;
+		const FrozenCode jump = { target, original, HookJumpSize };
+		freeze.Freeze( &jump, 1 );
+		if( MH_EnableHook( target ) != MH_OK )
+			return false;
+
+		const FrozenCode patched = { target, original, CompareHookCode( target, original ) };
+		freeze.RelocateThreads( patched, trampoline );
+		freeze.Release( );
+
+		RecordHookCode( target, trampoline, original );
+		return true;
+	}
+
 	Hook::Target::Target( ) { }
 
 	Hook::Target::Target( void *target ) : target_pointer( target ) { }
@@ -120,14 +163,14 @@ namespace Detouring
 		return module_name;
 	}
 
-	Hook::Hook( const Target &_target, void *_detour )
+	Hook::Hook( const Target &_target, void *_detour, bool soft )
 	{
-		Create( _target, _detour );
+		Create( _target, _detour, soft );
 	}
 
-	Hook::Hook( const Module &module, const std::string &_target, void *_detour )
+	Hook::Hook( const Module &module, const std::string &_target, void *_detour, bool soft )
 	{
-		Create( module, _target, _detour );
+		Create( module, _target, _detour, soft );
 	}
 
 	Hook::~Hook( )
@@ -140,11 +183,19 @@ namespace Detouring
 		return target != nullptr && detour != nullptr;
 	}
 
-	bool Hook::Create( const Target &_target, void *_detour )
+	bool Hook::Create( const Target &_target, void *_detour, bool soft )
 	{
 		if( !_target.IsValid( ) || _detour == nullptr )
 			return false;
 
+#if defined SYSTEM_LINUX
+
+		// Modules loaded since the last check get their deferred and global
+		// import hooks first
+		CheckLoadedModules( );
+
+#endif
+
 		void *pointer = nullptr;
 		if( _target.IsPointer( ) )
 			pointer = _target.GetPointer( );
@@ -154,19 +205,36 @@ namespace Detouring
 		if( pointer == nullptr )
 			return false;
 
-		MH_Initialize( );
+		Gate gate;
+		if( soft && !AllocateGate( gate, nullptr ) )
+			return false;
 
-		if( MH_CreateHook( pointer, _detour, &trampoline ) == MH_OK )
+		const auto create = [&]( )
+		{
+			std::lock_guard lock( GetMinHookMutex( ) );
+			MH_Initialize( );
+			return MH_CreateHook( pointer, soft ? gate.code : _detour, &trampoline );
+		};
+
+		// A destroyed hook on the same target may still be waiting to be released
+		MH_STATUS status = create( );
+		if( status == MH_ERROR_ALREADY_CREATED && ReleaseRetiredTarget( pointer ) )
+			status = create( );
+
+		if( status == MH_OK )
 		{
 			target = pointer;
 			detour = _detour;
-			return true;
+			gate_code = gate.code;
+			gate_slot = gate.slot;
+			return FinishCreate( );
 		}
 
+		FreeGate( gate );
 		return false;
 	}
 
-	bool Hook::Create( const Module &module, const std::string &_target, void *_detour )
+	bool Hook::Create( const Module &module, const std::string &_target, void *_detour, bool soft )
 	{
 		if( !module.IsValid( ) || _target.empty( ) )
 			return false;
@@ -174,51 +242,182 @@ namespace Detouring
 		if( module.IsPointer( ) )
 		{
 			void *pointer = FindSymbol( module.GetPointer( ), _target.c_str( ) );
-			return pointer != nullptr ? Create( pointer, _detour ) : false;
+			return pointer != nullptr ? Create( pointer, _detour, soft ) : false;
 		}
 
 		if( _detour == nullptr )
 			return false;
 
-		MH_Initialize( );
+#if defined SYSTEM_LINUX
 
-		if( MH_CreateHookApiEx( module.GetModuleName( ).c_str( ), _target.c_str( ), _detour, &trampoline, &target ) == MH_OK )
+		CheckLoadedModules( );
+
+#endif
+
+		Gate gate;
+		if( soft && !AllocateGate( gate, nullptr ) )
+			return false;
+
+		const auto create = [&]( )
+		{
+			std::lock_guard lock( GetMinHookMutex( ) );
+			MH_Initialize( );
+			return MH_CreateHookApiEx(
+				module.GetModuleName( ).c_str( ),
+				_target.c_str( ),
+				soft ? gate.code : _detour,
+				&trampoline,
+				&target
+			);
+		};
+
+		MH_STATUS status = create( );
+		if( status == MH_ERROR_ALREADY_CREATED && ReleaseRetiredTarget( target ) )
+			status = create( );
+
+		if( status == MH_OK )
 		{
 			detour = _detour;
-			return true;
+			gate_code = gate.code;
+			gate_slot = gate.slot;
+			return FinishCreate( );
+		}
+
+		FreeGate( gate );
+
+#if defined SYSTEM_LINUX
+
+		// Internal symbols are only reachable through the module's symbol tables
+		const auto index = SymbolIndex::Get( module );
+		if( index )
+		{
+			void *pointer = index->Find( _target );
+			if( pointer != nullptr )
+				return Create( pointer, _detour, soft );
 		}
 
+#endif
+
 		return false;
 	}
 
+	bool Hook::CreateDeferred( const Module &module, const std::string &_target, void *_detour )
+	{
+		return DeferHook( *this, module, _target, _detour );
+	}
+
+	bool Hook::IsDeferred( ) const
+	{
+		return IsDeferredHook( *this );
+	}
+
+	void Hook::CheckDeferred( )
+	{
+		CheckDeferredHooks( );
+	}
+
+	void Hook::WatchDlopen( )
+	{
+
+#if defined SYSTEM_LINUX
+
+		Detouring::WatchDlopen( );
+
+#endif
+
+	}
+
 	bool Hook::Destroy( )
 	{
+		// Checked first, since the module may be loading on another thread
+		if( CancelDeferredHook( *this ) )
+			return true;
+
 		if( target == nullptr )
 			return false;
 
-		if( MH_RemoveHook( target ) != MH_OK )
+		// Soft hooks stop calling the detour before the target is restored
+		if( gate_slot != nullptr )
+			gate_slot->store( trampoline, std::memory_order_release );
+
+		// MinHook still considers hooks with recorded code enabled, so it only
+		// rewrites the original bytes once they are already back in place
+		if(
+			gate_slot == nullptr &&
+			HasHookCode( target ) &&
+			HookRegistry::IsEnabled( target ) &&
+			!SetHookCode( target, trampoline, false )
+		)
 			return false;
 
+		{
+			std::lock_guard lock( GetMinHookMutex( ) );
+			const MH_STATUS status = MH_DisableHook( target );
+			if( status != MH_OK && status != MH_ERROR_DISABLED )
+				return false;
+		}
+
+		ForgetHookCode( target );
+
+		// Threads may still be running the trampoline, so it (and the gate)
+		// are only released once every epoch guard held until now is left
+		HookRegistry::Unregister( *this );
+		Gate gate;
+		gate.code = gate_code;
+		gate.slot = gate_slot;
+		RetireHook( target, gate );
+		gate_code = nullptr;
+		gate_slot = nullptr;
 		target = nullptr;
 		detour = nullptr;
 		trampoline = nullptr;
-		MH_Uninitialize( );
 		return true;
 	}
 
+	bool Hook::IsSoft( ) const
+	{
+		return gate_slot != nullptr;
+	}
+
 	bool Hook::IsEnabled( ) const
 	{
-		return IsValid( ) && MH_IsHookEnabled( target ) == MH_HOOK_ENABLED;
+		return IsValid( ) && HookRegistry::IsEnabled( target );
 	}
 
+	// Requests that would not change anything fail like MinHook's
+	// MH_ERROR_ENABLED and MH_ERROR_DISABLED, without its linear search
 	bool Hook::Enable( )
 	{
-		return IsValid( ) && MH_EnableHook( target ) == MH_OK;
+		if( !IsValid( ) )
+			return false;
+
+		if( gate_slot != nullptr )
+		{
+			if( gate_slot->exchange( detour, std::memory_order_acq_rel ) == detour )
+				return false;
+		}
+		else if( HookRegistry::IsEnabled( target ) || !SetHookCode( target, trampoline, true ) )
+			return false;
+
+		HookRegistry::SetEnabled( target, true );
+		return true;
 	}
 
 	bool Hook::Disable( )
 	{
-		return IsValid( ) && MH_DisableHook( target ) == MH_OK;
+		if( !IsValid( ) )
+			return false;
+
+		if( gate_slot != nullptr )
+		{
+			if( gate_slot->exchange( trampoline, std::memory_order_acq_rel ) == trampoline )
+				return false;
+		}
+		else if( !HookRegistry::IsEnabled( target ) || !SetHookCode( target, trampoline, false ) )
+			return false;
+
+		HookRegistry::SetEnabled( target, false );
+		return true;
 	}
 
 	void *Hook::GetTarget( ) const
@@ -231,11 +430,61 @@ namespace Detouring
 		return detour;
 	}
 
+	bool Hook::SetDetour( void *_detour )
+	{
+		if( !IsValid( ) || gate_slot == nullptr || _detour == nullptr )
+			return false;
+
+		void *previous = detour;
+		detour = _detour;
+
+		// Only an enabled hook has the detour in its gate
+		void *expected = previous;
+		gate_slot->compare_exchange_strong( expected, _detour, std::memory_order_acq_rel );
+
+		HookRegistry::SetDetour( *this, previous );
+		return true;
+	}
+
 	void *Hook::GetTrampoline( ) const
 	{
 		return trampoline;
 	}
 
+	bool Hook::FinishCreate( )
+	{
+		// Soft hooks are patched right away, starting routed to the trampoline
+		if( gate_slot != nullptr )
+		{
+			gate_slot->store( trampoline, std::memory_order_release );
+
+			std::unique_lock lock( GetMinHookMutex( ) );
+			if( MH_EnableHook( target ) != MH_OK )
+			{
+				MH_RemoveHook( target );
+				lock.unlock( );
+				ReleaseGate( );
+				target = nullptr;
+				detour = nullptr;
+				trampoline = nullptr;
+				return false;
+			}
+		}
+
+		HookRegistry::Register( *this );
+		return true;
+	}
+
+	void Hook::ReleaseGate( )
+	{
+		Gate gate;
+		gate.code = gate_code;
+		gate.slot = gate_slot;
+		FreeGate( gate );
+		gate_code = nullptr;
+		gate_slot = nullptr;
+	}
+
 	void *Hook::FindSymbol( const std::string &symbol )
 	{
 
@@ -267,7 +516,16 @@ namespace Detouring
 
 #elif defined SYSTEM_POSIX
 
-		return dlsym( RTLD_DEFAULT, symbol.c_str( ) );
+		void *pointer = dlsym( RTLD_DEFAULT, symbol.c_str( ) );
+
+#if defined SYSTEM_LINUX
+
+		if( pointer == nullptr )
+			pointer = SymbolIndex::FindInAllModules( symbol );
+
+#endif
+
+		return pointer;
 
 #endif
 
@@ -284,7 +542,20 @@ namespace Detouring
 
 #elif defined SYSTEM_POSIX
 
-		return dlsym( module, symbol.c_str( ) );
+		void *pointer = dlsym( module, symbol.c_str( ) );
+
+#if defined SYSTEM_LINUX
+
+		if( pointer == nullptr )
+		{
+			const auto index = SymbolIndex::Get( module );
+			if( index )
+				pointer = index->Find( symbol );
+		}
+
+#endif
+
+		return pointer;
 
 #endif
 
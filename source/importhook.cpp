@@ -0,0 +1,381 @@
+/*************************************************************************
+* Detouring::ImportHook
+* A C++ class that detours the imports of a single module by rewriting
+* its GOT slots.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "importhook.hpp"
+#include "helpers.hpp"
+#include "platform.hpp"
+#include "module.hpp"
+#include "slots.hpp"
+#include "elf.hpp"
+#include "loader.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+#if defined SYSTEM_LINUX
+
+#include <dlfcn.h>
+
+#endif
+
+namespace Detouring
+{
+
+#if defined SYSTEM_LINUX
+
+	struct ImportSearch
+	{
+		uintptr_t base;
+		const char *name;
+		std::vector<void **> *slots;
+		bool found;
+	};
+
+	static int FindModuleImports( dl_phdr_info *phdr, size_t, void *data )
+	{
+		ImportSearch &search = *static_cast<ImportSearch *>( data );
+		if( static_cast<uintptr_t>( phdr->dlpi_addr ) != search.base )
+			return 0;
+
+		DynamicInfo info;
+		if( GetDynamicInfo( *phdr, info ) )
+			FindImportSlots( info, search.name, *search.slots );
+
+		search.found = true;
+		return 1;
+	}
+
+	static bool IsModuleAddress( const ModuleInfo &info, const void *address )
+	{
+		const uintptr_t _address = reinterpret_cast<uintptr_t>( address );
+		for( const MemoryRegion &segment : info.segments )
+			if( _address >= segment.start && _address < segment.end )
+				return true;
+
+		return false;
+	}
+
+	struct GlobalSearch
+	{
+		uintptr_t address;
+		uintptr_t excluded_base;
+		std::vector<DynamicInfo> modules;
+	};
+
+	static int CollectModules( dl_phdr_info *phdr, size_t, void *data )
+	{
+		GlobalSearch &search = *static_cast<GlobalSearch *>( data );
+		for( ElfW( Half ) k = 0; k < phdr->dlpi_phnum; ++k )
+		{
+			const ElfW( Phdr ) &header = phdr->dlpi_phdr[k];
+			const uintptr_t start = static_cast<uintptr_t>( phdr->dlpi_addr + header.p_vaddr );
+			if( header.p_type == PT_LOAD && search.address >= start && search.address - start < header.p_memsz )
+				search.excluded_base = static_cast<uintptr_t>( phdr->dlpi_addr );
+		}
+
+		DynamicInfo info;
+		if( GetDynamicInfo( *phdr, info ) )
+			search.modules.push_back( std::move( info ) );
+
+		return 0;
+	}
+
+	struct GlobalImports
+	{
+		std::mutex mutex;
+		std::vector<ImportHook *> hooks;
+	};
+
+	// Never destroyed, since hooks with static storage duration are
+	// destroyed during exit
+	static GlobalImports &GetGlobalImports( )
+	{
+		static GlobalImports *imports = new GlobalImports( );
+		return *imports;
+	}
+
+	void ApplyGlobalImports( const DynamicInfo &module )
+	{
+		GlobalImports &imports = GetGlobalImports( );
+		std::lock_guard lock( imports.mutex );
+		for( ImportHook *hook : imports.hooks )
+		{
+			if( module.base == hook->excluded_base )
+				continue;
+
+			std::vector<void **> found;
+			if( FindImportSlots( module, hook->import.c_str( ), found ) != 0 )
+				hook->Attach( found );
+		}
+	}
+
+#endif
+
+	ImportHook::ImportHook( const Hook::Module &module, const std::string &_import, void *_detour )
+	{
+		Create( module, _import, _detour );
+	}
+
+	ImportHook::ImportHook( void **slot, void *_detour )
+	{
+		Create( slot, _detour );
+	}
+
+	ImportHook::ImportHook( const std::string &_import, void *_detour )
+	{
+		Create( _import, _detour );
+	}
+
+	ImportHook::~ImportHook( )
+	{
+		Destroy( );
+	}
+
+	bool ImportHook::IsValid( ) const
+	{
+		return detour != nullptr;
+	}
+
+	bool ImportHook::Create( const Hook::Module &module, const std::string &_import, void *_detour )
+	{
+		if( IsValid( ) || !module.IsValid( ) || _import.empty( ) || _detour == nullptr )
+			return false;
+
+#if defined SYSTEM_LINUX
+
+		ModuleInfo info;
+		if( !GetModuleInfo( module, info ) )
+			return false;
+
+		std::vector<void **> found;
+		ImportSearch search = { info.base, _import.c_str( ), &found, false };
+		dl_iterate_phdr( FindModuleImports, &search );
+		if( found.empty( ) )
+			return false;
+
+		// Lazily bound slots still point at the module's own PLT, and calling
+		// that would bind the slot again, so the original is looked up instead
+		void *address = *found.front( );
+		if( IsModuleAddress( info, address ) )
+			address = dlsym( RTLD_DEFAULT, _import.c_str( ) );
+
+		if( address == nullptr )
+			return false;
+
+		detour = _detour;
+		original = address;
+		import = _import;
+		if( !Attach( found ) )
+		{
+			Destroy( );
+			return false;
+		}
+
+		return true;
+
+#else
+
+		return false;
+
+#endif
+
+	}
+
+	bool ImportHook::Create( void **slot, void *_detour )
+	{
+		if( IsValid( ) || slot == nullptr || _detour == nullptr )
+			return false;
+
+		detour = _detour;
+		original = *slot;
+		if( !Attach( { slot } ) )
+		{
+			Destroy( );
+			return false;
+		}
+
+		return true;
+	}
+
+	bool ImportHook::Create( const std::string &_import, void *_detour )
+	{
+		if( IsValid( ) || _import.empty( ) || _detour == nullptr )
+			return false;
+
+#if defined SYSTEM_LINUX
+
+		void *address = dlsym( RTLD_DEFAULT, _import.c_str( ) );
+		if( address == nullptr )
+			return false;
+
+		// Modules loaded since the last check get the other hooks first
+		Detouring::CheckLoadedModules( );
+
+		// Registered first, so modules loaded while the current ones are
+		// being hooked are reported afterwards
+		AddModuleLoadCallback( ApplyGlobalImports );
+
+		GlobalImports &imports = GetGlobalImports( );
+		std::lock_guard lock( imports.mutex );
+
+		GlobalSearch search = { reinterpret_cast<uintptr_t>( _detour ), UINTPTR_MAX, { } };
+		dl_iterate_phdr( CollectModules, &search );
+
+		std::vector<void **> found;
+		for( const DynamicInfo &module : search.modules )
+			if( module.base != search.excluded_base )
+				FindImportSlots( module, _import.c_str( ), found );
+
+		detour = _detour;
+		original = address;
+		import = _import;
+
+		// Not global yet, so this only restores the slots already written
+		if( !Attach( found ) )
+		{
+			Destroy( );
+			return false;
+		}
+
+		global = true;
+		excluded_base = search.excluded_base;
+		imports.hooks.push_back( this );
+		return true;
+
+#else
+
+		return false;
+
+#endif
+
+	}
+
+	bool ImportHook::Destroy( )
+	{
+		if( !IsValid( ) )
+			return false;
+
+#if defined SYSTEM_LINUX
+
+		if( global )
+		{
+			GlobalImports &imports = GetGlobalImports( );
+			std::lock_guard lock( imports.mutex );
+			imports.hooks.erase( std::find( imports.hooks.begin( ), imports.hooks.end( ), this ) );
+		}
+
+#endif
+
+		// Slots of modules unloaded since are no longer mapped
+		std::vector<int32_t> protections( slots.size( ) );
+		GetMemoryProtection( reinterpret_cast<void *const *>( slots.data( ) ), slots.size( ), protections.data( ) );
+
+		std::vector<void **> restored_slots;
+		std::vector<void *> restored_values;
+		for( size_t k = 0; k < slots.size( ); ++k )
+			if(
+				protections[k] >= MemoryProtection::None &&
+				( protections[k] & MemoryProtection::Read ) != 0 &&
+				*slots[k] == detour
+			)
+			{
+				restored_slots.push_back( slots[k] );
+				restored_values.push_back( previous[k] );
+			}
+
+		const bool restored = WriteSlots( restored_slots.data( ), restored_values.data( ), restored_slots.size( ) );
+		slots.clear( );
+		previous.clear( );
+		detour = nullptr;
+		original = nullptr;
+		import.clear( );
+		global = false;
+		excluded_base = UINTPTR_MAX;
+		return restored;
+	}
+
+	bool ImportHook::IsGlobal( ) const
+	{
+		return global;
+	}
+
+	void ImportHook::CheckLoadedModules( )
+	{
+
+#if defined SYSTEM_LINUX
+
+		Detouring::CheckLoadedModules( );
+
+#endif
+
+	}
+
+	const std::vector<void **> &ImportHook::GetSlots( ) const
+	{
+		return slots;
+	}
+
+	void *ImportHook::GetDetour( ) const
+	{
+		return detour;
+	}
+
+	void *ImportHook::GetOriginal( ) const
+	{
+		return original;
+	}
+
+	bool ImportHook::Attach( const std::vector<void **> &found )
+	{
+		std::vector<void **> added;
+		for( void **slot : found )
+			if( *slot != detour && std::find( slots.begin( ), slots.end( ), slot ) == slots.end( ) )
+				added.push_back( slot );
+
+		if( added.empty( ) )
+			return true;
+
+		// Lazily bound slots go back to the PLT when restored
+		std::vector<void *> values( added.size( ), detour );
+		for( void **slot : added )
+		{
+			slots.push_back( slot );
+			previous.push_back( *slot );
+		}
+
+		return WriteSlots( added.data( ), values.data( ), added.size( ) );
+	}
+}
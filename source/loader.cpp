@@ -0,0 +1,227 @@
+/*************************************************************************
+* Detouring::AddModuleLoadCallback
+* Internal notifications for modules loaded after startup.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "loader.hpp"
+
+#if defined SYSTEM_LINUX
+
+#include "slots.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include <dlfcn.h>
+
+namespace Detouring
+{
+	namespace
+	{
+		struct Loader
+		{
+			std::mutex mutex;
+			std::vector<ModuleLoadCallback> callbacks;
+			std::vector<uintptr_t> modules;
+			unsigned long long generation = 0;
+			bool initialized = false;
+
+			// Set once WatchDlopen is used
+			void *dlopen = nullptr;
+		};
+
+		// Never destroyed, since dlopen may still be called during exit
+		Loader &GetLoader( )
+		{
+			static Loader *loader = new Loader( );
+			return *loader;
+		}
+
+		struct ModuleScan
+		{
+			unsigned long long generation = 0;
+			std::vector<uintptr_t> bases;
+			std::vector<DynamicInfo> modules;
+		};
+
+		int ScanModules( dl_phdr_info *phdr, size_t size, void *data )
+		{
+			ModuleScan &scan = *static_cast<ModuleScan *>( data );
+			if( size >= offsetof( dl_phdr_info, dlpi_adds ) + sizeof( phdr->dlpi_adds ) )
+				scan.generation = phdr->dlpi_adds;
+
+			DynamicInfo info;
+			if( GetDynamicInfo( *phdr, info ) )
+			{
+				info.path = phdr->dlpi_name != nullptr ? phdr->dlpi_name : "";
+				scan.bases.push_back( info.base );
+				scan.modules.push_back( std::move( info ) );
+			}
+
+			return 0;
+		}
+
+		// Only the generation is read, so nothing is allocated
+		int GetGeneration( dl_phdr_info *phdr, size_t size, void *data )
+		{
+			if( size >= offsetof( dl_phdr_info, dlpi_adds ) + sizeof( phdr->dlpi_adds ) )
+				*static_cast<unsigned long long *>( data ) = phdr->dlpi_adds;
+
+			return 1;
+		}
+
+		// Set while callbacks run, since they may load modules or create
+		// hooks themselves. Those loads are reported once they return.
+		thread_local bool checking = false;
+
+		void *DetourDlopen( const char *file, int mode )
+		{
+			void *handle = reinterpret_cast<void *( * )( const char *, int )>( GetLoader( ).dlopen )( file, mode );
+			if( handle != nullptr )
+				CheckLoadedModules( );
+
+			return handle;
+		}
+
+		// The caller holds the loader lock
+		void HookDlopen( const std::vector<DynamicInfo> &modules )
+		{
+			if( GetLoader( ).dlopen == nullptr )
+				return;
+
+			std::vector<void **> slots;
+			for( const DynamicInfo &module : modules )
+				FindImportSlots( module, "dlopen", slots );
+
+			std::vector<void *> values( slots.size( ), reinterpret_cast<void *>( DetourDlopen ) );
+			WriteSlots( slots.data( ), values.data( ), slots.size( ) );
+		}
+	}
+
+	void AddModuleLoadCallback( ModuleLoadCallback callback )
+	{
+		Loader &loader = GetLoader( );
+		std::lock_guard lock( loader.mutex );
+		if( std::find( loader.callbacks.begin( ), loader.callbacks.end( ), callback ) != loader.callbacks.end( ) )
+			return;
+
+		loader.callbacks.push_back( callback );
+		if( loader.initialized )
+			return;
+
+		// Modules loaded before the first callback are not reported
+		ModuleScan scan;
+		dl_iterate_phdr( ScanModules, &scan );
+		std::sort( scan.bases.begin( ), scan.bases.end( ) );
+		loader.modules = std::move( scan.bases );
+		loader.generation = scan.generation;
+		loader.initialized = true;
+	}
+
+	void WatchDlopen( )
+	{
+		Loader &loader = GetLoader( );
+		std::lock_guard lock( loader.mutex );
+		if( loader.dlopen != nullptr )
+			return;
+
+		loader.dlopen = dlsym( RTLD_DEFAULT, "dlopen" );
+		if( loader.dlopen == nullptr )
+			return;
+
+		ModuleScan scan;
+		dl_iterate_phdr( ScanModules, &scan );
+		HookDlopen( scan.modules );
+		if( loader.initialized )
+			return;
+
+		// Modules loaded before are not reported, like for the first callback
+		std::sort( scan.bases.begin( ), scan.bases.end( ) );
+		loader.modules = std::move( scan.bases );
+		loader.generation = scan.generation;
+		loader.initialized = true;
+	}
+
+	void CheckLoadedModules( )
+	{
+		if( checking )
+			return;
+
+		Loader &loader = GetLoader( );
+		while( true )
+		{
+			std::vector<ModuleLoadCallback> callbacks;
+			std::vector<DynamicInfo> added;
+
+			{
+				std::lock_guard lock( loader.mutex );
+				if( !loader.initialized )
+					return;
+
+				unsigned long long generation = 0;
+				dl_iterate_phdr( GetGeneration, &generation );
+				if( generation != 0 && generation == loader.generation )
+					return;
+
+				ModuleScan scan;
+				dl_iterate_phdr( ScanModules, &scan );
+				for( DynamicInfo &module : scan.modules )
+					if( !std::binary_search( loader.modules.begin( ), loader.modules.end( ), module.base ) )
+						added.push_back( std::move( module ) );
+
+				// A module unloaded and replaced at the same base in between
+				// two checks is not reported
+				std::sort( scan.bases.begin( ), scan.bases.end( ) );
+				loader.modules = std::move( scan.bases );
+				loader.generation = scan.generation;
+				HookDlopen( added );
+				callbacks = loader.callbacks;
+			}
+
+			if( added.empty( ) )
+				return;
+
+			checking = true;
+			for( const ModuleLoadCallback callback : callbacks )
+				for( const DynamicInfo &module : added )
+					callback( module );
+
+			checking = false;
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*************************************************************************
+* Detouring::AddModuleLoadCallback
+* Internal notifications for modules loaded after startup.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "platform.hpp"
+#include "elf.hpp"
+
+namespace Detouring
+{
+
+#if defined SYSTEM_LINUX
+
+	typedef void ( *ModuleLoadCallback )( const DynamicInfo &module );
+
+	// Loads are noticed by CheckLoadedModules, which hook creation calls, so
+	// the dlopen of the caller is never replaced unless WatchDlopen is used,
+	// which the first deferred hook does.
+	// Callbacks run on the checking thread, outside of any lock.
+	void AddModuleLoadCallback( ModuleLoadCallback callback );
+
+	// Hooks the dlopen import of every module (and of the ones loaded later)
+	// to check once it returns. Modules loaded through the wrapper resolve
+	// RPATH, RUNPATH, $ORIGIN and their namespace against this library
+	// instead of the original caller.
+	void WatchDlopen( );
+
+	// Reports the modules that appeared since the last check to every
+	// callback. Returns right away when the link map generation is unchanged.
+	void CheckLoadedModules( );
+
+#endif
+
+}
@@ -0,0 +1,132 @@
+/*************************************************************************
+* Detouring::MappedFile
+* Internal read-only file mapping.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "mappedfile.hpp"
+#include "platform.hpp"
+
+#if defined SYSTEM_WINDOWS
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+
+#elif defined SYSTEM_POSIX
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#endif
+
+namespace Detouring
+{
+	MappedFile::MappedFile( const std::string &path )
+	{
+
+#if defined SYSTEM_WINDOWS
+
+		HANDLE file = CreateFileA(
+			path.c_str( ),
+			GENERIC_READ,
+			FILE_SHARE_READ | FILE_SHARE_DELETE,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL,
+			nullptr
+		);
+		if( file == INVALID_HANDLE_VALUE )
+			return;
+
+		LARGE_INTEGER file_size;
+		if( GetFileSizeEx( file, &file_size ) && file_size.QuadPart > 0 )
+		{
+			HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+			if( mapping != nullptr )
+			{
+				void *view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+				if( view != nullptr )
+				{
+					data = static_cast<const uint8_t *>( view );
+					size = static_cast<size_t>( file_size.QuadPart );
+				}
+
+				// The view keeps the mapping alive
+				CloseHandle( mapping );
+			}
+		}
+
+		CloseHandle( file );
+
+#elif defined SYSTEM_POSIX
+
+		const int fd = open( path.c_str( ), O_RDONLY | O_CLOEXEC );
+		if( fd == -1 )
+			return;
+
+		struct stat status;
+		if( fstat( fd, &status ) == 0 && status.st_size > 0 )
+		{
+			void *mapping = mmap( nullptr, static_cast<size_t>( status.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+			if( mapping != MAP_FAILED )
+			{
+				data = static_cast<const uint8_t *>( mapping );
+				size = static_cast<size_t>( status.st_size );
+			}
+		}
+
+		close( fd );
+
+#endif
+
+	}
+
+	MappedFile::~MappedFile( )
+	{
+		if( data == nullptr )
+			return;
+
+#if defined SYSTEM_WINDOWS
+
+		UnmapViewOfFile( data );
+
+#elif defined SYSTEM_POSIX
+
+		munmap( const_cast<uint8_t *>( data ), size );
+
+#endif
+
+	}
+}
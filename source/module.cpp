@@ -0,0 +1,470 @@
+/*************************************************************************
+* Detouring::ModuleInfo
+* Internal helpers for locating loaded modules.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "module.hpp"
+#include "elf.hpp"
+#include "platform.hpp"
+
+#include <cstring>
+
+#if defined SYSTEM_WINDOWS
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+#include <Psapi.h>
+
+#elif defined SYSTEM_POSIX
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <dlfcn.h>
+
+#if defined SYSTEM_LINUX
+
+#include <link.h>
+#include <unistd.h>
+
+#elif defined SYSTEM_MACOSX
+
+#include <mach-o/dyld.h>
+#include <mach-o/loader.h>
+
+#endif
+
+#endif
+
+namespace Detouring
+{
+
+#if defined SYSTEM_POSIX
+
+	bool IsModuleName( const std::string &name, const char *path )
+	{
+		if( path == nullptr || path[0] == '\0' )
+			return false;
+
+		const char *slash = std::strrchr( path, '/' );
+		return name == path || name == ( slash != nullptr ? slash + 1 : path );
+	}
+
+#endif
+
+#if defined SYSTEM_LINUX
+
+	static std::string GetExecutablePath( )
+	{
+		char path[4096] = { 0 };
+		const ssize_t length = readlink( "/proc/self/exe", path, sizeof( path ) - 1 );
+		return length > 0 ? std::string( path, static_cast<size_t>( length ) ) : std::string( );
+	}
+
+	static void AddSegments( const dl_phdr_info &phdr, ModuleInfo &info )
+	{
+		for( ElfW( Half ) k = 0; k < phdr.dlpi_phnum; ++k )
+		{
+			const ElfW( Phdr ) &header = phdr.dlpi_phdr[k];
+			if( header.p_type == PT_NOTE && info.build_id.empty( ) )
+			{
+				const void *notes = reinterpret_cast<const void *>( phdr.dlpi_addr + header.p_vaddr );
+				GetBuildId( notes, static_cast<size_t>( header.p_memsz ), info.build_id );
+				continue;
+			}
+
+			if( header.p_type != PT_LOAD || header.p_memsz == 0 )
+				continue;
+
+			int32_t protection = MemoryProtection::None;
+
+			if( ( header.p_flags & PF_R ) != 0 )
+				protection |= MemoryProtection::Read;
+
+			if( ( header.p_flags & PF_W ) != 0 )
+				protection |= MemoryProtection::Write;
+
+			if( ( header.p_flags & PF_X ) != 0 )
+				protection |= MemoryProtection::Execute;
+
+			const uintptr_t start = static_cast<uintptr_t>( phdr.dlpi_addr + header.p_vaddr );
+			info.segments.push_back( { start, start + static_cast<uintptr_t>( header.p_memsz ), protection } );
+		}
+	}
+
+	static int FindModuleSegments( dl_phdr_info *phdr, size_t, void *data )
+	{
+		ModuleInfo *info = static_cast<ModuleInfo *>( data );
+		if( static_cast<uintptr_t>( phdr->dlpi_addr ) != info->base )
+			return 0;
+
+		const bool is_executable = phdr->dlpi_name == nullptr || phdr->dlpi_name[0] == '\0';
+		if( !is_executable && info->path != phdr->dlpi_name )
+			return 0;
+
+		AddSegments( *phdr, *info );
+		return 1;
+	}
+
+	static bool GetLinkMapInfo( void *handle, ModuleInfo &info )
+	{
+		link_map *map = nullptr;
+		if( dlinfo( handle, RTLD_DI_LINKMAP, &map ) != 0 || map == nullptr )
+			return false;
+
+		info.base = static_cast<uintptr_t>( map->l_addr );
+		info.path = map->l_name != nullptr && map->l_name[0] != '\0' ? map->l_name : GetExecutablePath( );
+		return true;
+	}
+
+	struct ModuleSearch
+	{
+		const std::string *name;
+		const std::string *executable_path;
+		ModuleInfo *info;
+		bool found;
+	};
+
+	static int FindModuleByName( dl_phdr_info *phdr, size_t, void *data )
+	{
+		ModuleSearch *search = static_cast<ModuleSearch *>( data );
+		const char *path = phdr->dlpi_name != nullptr && phdr->dlpi_name[0] != '\0' ?
+			phdr->dlpi_name : search->executable_path->c_str( );
+		if( !IsModuleName( *search->name, path ) )
+			return 0;
+
+		search->info->path = path;
+		search->info->base = static_cast<uintptr_t>( phdr->dlpi_addr );
+		AddSegments( *phdr, *search->info );
+		search->found = true;
+		return 1;
+	}
+
+	static int ListModules( dl_phdr_info *phdr, size_t, void *data )
+	{
+		std::vector<ModuleInfo> *modules = static_cast<std::vector<ModuleInfo> *>( data );
+
+		ModuleInfo info;
+		info.path = phdr->dlpi_name != nullptr && phdr->dlpi_name[0] != '\0' ?
+			phdr->dlpi_name : GetExecutablePath( );
+		info.base = static_cast<uintptr_t>( phdr->dlpi_addr );
+
+		// Skip the vDSO, which has no file backing it
+		if( info.path.find( '/' ) == std::string::npos )
+			return 0;
+
+		AddSegments( *phdr, info );
+		modules->push_back( std::move( info ) );
+
+		return 0;
+	}
+
+#elif defined SYSTEM_MACOSX
+
+	static void GetImageInfo( uint32_t index, ModuleInfo &info )
+	{
+		const mach_header *header = _dyld_get_image_header( index );
+		const uintptr_t slide = static_cast<uintptr_t>( _dyld_get_image_vmaddr_slide( index ) );
+		info.path = _dyld_get_image_name( index );
+		info.base = reinterpret_cast<uintptr_t>( header );
+
+#ifdef ARCHITECTURE_X86_64
+
+		typedef segment_command_64 segment_command_type;
+		const uint32_t segment_command_id = LC_SEGMENT_64;
+		const uint8_t *command = reinterpret_cast<const uint8_t *>( header ) + sizeof( mach_header_64 );
+
+#else
+
+		typedef segment_command segment_command_type;
+		const uint32_t segment_command_id = LC_SEGMENT;
+		const uint8_t *command = reinterpret_cast<const uint8_t *>( header ) + sizeof( mach_header );
+
+#endif
+
+		for( uint32_t k = 0; k < header->ncmds; ++k )
+		{
+			const load_command *load = reinterpret_cast<const load_command *>( command );
+			if( load->cmd == segment_command_id )
+			{
+				const segment_command_type *segment = reinterpret_cast<const segment_command_type *>( command );
+				if( segment->vmsize != 0 )
+				{
+					int32_t protection = MemoryProtection::None;
+
+					if( ( segment->initprot & VM_PROT_READ ) != 0 )
+						protection |= MemoryProtection::Read;
+
+					if( ( segment->initprot & VM_PROT_WRITE ) != 0 )
+						protection |= MemoryProtection::Write;
+
+					if( ( segment->initprot & VM_PROT_EXECUTE ) != 0 )
+						protection |= MemoryProtection::Execute;
+
+					const uintptr_t start = static_cast<uintptr_t>( segment->vmaddr ) + slide;
+					info.segments.push_back( { start, start + static_cast<uintptr_t>( segment->vmsize ), protection } );
+				}
+			}
+
+			else if( load->cmd == LC_UUID )
+			{
+				const uuid_command *uuid = reinterpret_cast<const uuid_command *>( command );
+				info.build_id.assign( reinterpret_cast<const char *>( uuid->uuid ), sizeof( uuid->uuid ) );
+			}
+
+			command += load->cmdsize;
+		}
+	}
+
+#endif
+
+	std::string GetModuleName( const Hook::Module &module )
+	{
+		if( !module.GetName( ).empty( ) )
+			return module.GetName( );
+
+		// Encode the wide name as UTF-8
+		std::string name;
+		for( const wchar_t character : module.GetModuleName( ) )
+		{
+			const uint32_t code = static_cast<uint32_t>( character );
+			if( code < 0x80 )
+				name += static_cast<char>( code );
+			else if( code < 0x800 )
+			{
+				name += static_cast<char>( 0xC0 | ( code >> 6 ) );
+				name += static_cast<char>( 0x80 | ( code & 0x3F ) );
+			}
+			else if( code < 0x10000 )
+			{
+				name += static_cast<char>( 0xE0 | ( code >> 12 ) );
+				name += static_cast<char>( 0x80 | ( ( code >> 6 ) & 0x3F ) );
+				name += static_cast<char>( 0x80 | ( code & 0x3F ) );
+			}
+			else
+			{
+				name += static_cast<char>( 0xF0 | ( code >> 18 ) );
+				name += static_cast<char>( 0x80 | ( ( code >> 12 ) & 0x3F ) );
+				name += static_cast<char>( 0x80 | ( ( code >> 6 ) & 0x3F ) );
+				name += static_cast<char>( 0x80 | ( code & 0x3F ) );
+			}
+		}
+
+		return name;
+	}
+
+	bool GetModuleInfo( const Hook::Module &module, ModuleInfo &info )
+	{
+		if( !module.IsValid( ) )
+			return false;
+
+#if defined SYSTEM_WINDOWS
+
+		HMODULE handle = module.IsPointer( ) ?
+			reinterpret_cast<HMODULE>( module.GetPointer( ) ) :
+			GetModuleHandleW( module.GetModuleName( ).c_str( ) );
+		if( handle == nullptr )
+			return false;
+
+		char path[MAX_PATH] = { 0 };
+		const DWORD length = GetModuleFileNameA( handle, path, MAX_PATH );
+		if( length == 0 )
+			return false;
+
+		info.path.assign( path, length );
+		info.base = reinterpret_cast<uintptr_t>( handle );
+
+		const IMAGE_DOS_HEADER *dos_header = reinterpret_cast<const IMAGE_DOS_HEADER *>( handle );
+		const IMAGE_NT_HEADERS *nt_headers =
+			reinterpret_cast<const IMAGE_NT_HEADERS *>( info.base + dos_header->e_lfanew );
+		const IMAGE_SECTION_HEADER *sections = IMAGE_FIRST_SECTION( nt_headers );
+		for( WORD k = 0; k < nt_headers->FileHeader.NumberOfSections; ++k )
+		{
+			const IMAGE_SECTION_HEADER &section = sections[k];
+			int32_t protection = MemoryProtection::None;
+
+			if( ( section.Characteristics & IMAGE_SCN_MEM_READ ) != 0 )
+				protection |= MemoryProtection::Read;
+
+			if( ( section.Characteristics & IMAGE_SCN_MEM_WRITE ) != 0 )
+				protection |= MemoryProtection::Write;
+
+			if( ( section.Characteristics & IMAGE_SCN_MEM_EXECUTE ) != 0 )
+				protection |= MemoryProtection::Execute;
+
+			const uintptr_t start = info.base + section.VirtualAddress;
+			info.segments.push_back( { start, start + section.Misc.VirtualSize, protection } );
+		}
+
+		const IMAGE_DATA_DIRECTORY &debug_directory =
+			nt_headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_DEBUG];
+		const IMAGE_DEBUG_DIRECTORY *debug_entries =
+			reinterpret_cast<const IMAGE_DEBUG_DIRECTORY *>( info.base + debug_directory.VirtualAddress );
+		const DWORD debug_count = debug_directory.VirtualAddress != 0 ?
+			debug_directory.Size / sizeof( IMAGE_DEBUG_DIRECTORY ) : 0;
+		for( DWORD k = 0; k < debug_count; ++k )
+		{
+			const IMAGE_DEBUG_DIRECTORY &entry = debug_entries[k];
+			if( entry.Type != IMAGE_DEBUG_TYPE_CODEVIEW || entry.AddressOfRawData == 0 || entry.SizeOfData < 24 )
+				continue;
+
+			// "RSDS" signature followed by the PDB GUID and age
+			const char *codeview = reinterpret_cast<const char *>( info.base + entry.AddressOfRawData );
+			if( std::memcmp( codeview, "RSDS", 4 ) == 0 )
+			{
+				info.build_id.assign( codeview + 4, 20 );
+				break;
+			}
+		}
+
+		if( info.build_id.empty( ) )
+		{
+			const DWORD identity[2] = {
+				nt_headers->FileHeader.TimeDateStamp,
+				nt_headers->OptionalHeader.SizeOfImage
+			};
+			info.build_id.assign( reinterpret_cast<const char *>( identity ), sizeof( identity ) );
+		}
+
+		return true;
+
+#elif defined SYSTEM_LINUX
+
+		if( module.IsPointer( ) )
+		{
+			if( !GetLinkMapInfo( module.GetPointer( ), info ) )
+				return false;
+
+			dl_iterate_phdr( FindModuleSegments, &info );
+			return true;
+		}
+
+		const std::string name = GetModuleName( module );
+		void *handle = dlopen( name.c_str( ), RTLD_LAZY | RTLD_NOLOAD );
+		if( handle != nullptr )
+		{
+			const bool found = GetLinkMapInfo( handle, info );
+			dlclose( handle );
+			if( found )
+			{
+				dl_iterate_phdr( FindModuleSegments, &info );
+				return true;
+			}
+		}
+
+		const std::string executable_path = GetExecutablePath( );
+		ModuleSearch search = { &name, &executable_path, &info, false };
+		dl_iterate_phdr( FindModuleByName, &search );
+		return search.found;
+
+#elif defined SYSTEM_MACOSX
+
+		const std::string name = GetModuleName( module );
+		for( uint32_t k = 0; k < _dyld_image_count( ); ++k )
+		{
+			const char *image = _dyld_get_image_name( k );
+			bool found = false;
+			if( module.IsPointer( ) )
+			{
+				void *handle = dlopen( image, RTLD_LAZY | RTLD_NOLOAD );
+				if( handle != nullptr )
+				{
+					found = handle == module.GetPointer( );
+					dlclose( handle );
+				}
+			}
+			else
+				found = IsModuleName( name, image );
+
+			if( found )
+			{
+				GetImageInfo( k, info );
+				return true;
+			}
+		}
+
+		return false;
+
+#endif
+
+	}
+
+	std::vector<ModuleInfo> GetLoadedModules( )
+	{
+		std::vector<ModuleInfo> modules;
+
+#if defined SYSTEM_WINDOWS
+
+		std::vector<HMODULE> handles( 256 );
+		DWORD size = static_cast<DWORD>( handles.size( ) * sizeof( HMODULE ) );
+		DWORD needed = 0;
+		if( !EnumProcessModules( GetCurrentProcess( ), handles.data( ), size, &needed ) )
+			return modules;
+
+		if( needed > size )
+		{
+			handles.resize( needed / sizeof( HMODULE ) );
+			size = needed;
+			needed = 0;
+			if( !EnumProcessModules( GetCurrentProcess( ), handles.data( ), size, &needed ) )
+				return modules;
+		}
+
+		handles.resize( needed / sizeof( HMODULE ) );
+		for( HMODULE handle : handles )
+		{
+			ModuleInfo info;
+			if( GetModuleInfo( Hook::Module( reinterpret_cast<void *>( handle ) ), info ) )
+				modules.push_back( std::move( info ) );
+		}
+
+#elif defined SYSTEM_LINUX
+
+		dl_iterate_phdr( ListModules, &modules );
+
+#elif defined SYSTEM_MACOSX
+
+		for( uint32_t k = 0; k < _dyld_image_count( ); ++k )
+		{
+			ModuleInfo info;
+			GetImageInfo( k, info );
+			modules.push_back( std::move( info ) );
+		}
+
+#endif
+
+		return modules;
+	}
+}
@@ -0,0 +1,70 @@
+/*************************************************************************
+* Detouring::ModuleInfo
+* Internal helpers for locating loaded modules.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#pragma once
+
+#include "hook.hpp"
+#include "helpers.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Detouring
+{
+	struct ModuleInfo
+	{
+		std::string path;
+		uintptr_t base = 0;
+		std::vector<MemoryRegion> segments;
+
+		// NT_GNU_BUILD_ID on Linux, LC_UUID on macOS and the CodeView
+		// GUID and age (or the link time and image size) on Windows
+		std::string build_id;
+	};
+
+	std::string GetModuleName( const Hook::Module &module );
+
+#if defined SYSTEM_POSIX
+
+	// Matches either the full path or its file name
+	bool IsModuleName( const std::string &name, const char *path );
+
+#endif
+
+	bool GetModuleInfo( const Hook::Module &module, ModuleInfo &info );
+
+	std::vector<ModuleInfo> GetLoadedModules( );
+}
@@ -0,0 +1,213 @@
+/*************************************************************************
+* Detouring::HookRegistry
+* A C++ class that indexes every Detouring::Hook in the process by its
+* target, detour and trampoline addresses.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "registry.hpp"
+#include "flatmap.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+
+namespace Detouring
+{
+	namespace
+	{
+		struct Registry
+		{
+			std::shared_mutex mutex;
+			FlatMap<HookRegistry::Entry> targets;
+			FlatMap<void *> trampolines;
+			FlatMap<std::vector<void *>> detours;
+		};
+
+		// Never destroyed, since hooks with static storage duration
+		// unregister themselves during exit
+		Registry &GetRegistry( )
+		{
+			static Registry *registry = new Registry( );
+			return *registry;
+		}
+
+		bool FindTarget( Registry &registry, const void *target, HookRegistry::Entry &entry )
+		{
+			const auto it = registry.targets.find( target );
+			if( it == registry.targets.end( ) )
+				return false;
+
+			entry = it->second;
+			return true;
+		}
+
+		void RemoveDetour( Registry &registry, const void *detour, void *target )
+		{
+			const auto it = registry.detours.find( detour );
+			if( it == registry.detours.end( ) )
+				return;
+
+			std::vector<void *> &targets = it->second;
+			targets.erase( std::remove( targets.begin( ), targets.end( ), target ), targets.end( ) );
+			if( targets.empty( ) )
+				registry.detours.erase( it );
+		}
+	}
+
+	bool HookRegistry::Find( const void *address, Entry &entry )
+	{
+		return FindByTarget( address, entry ) ||
+			FindByTrampoline( address, entry ) ||
+			FindByDetour( address, entry );
+	}
+
+	bool HookRegistry::FindByTarget( const void *target, Entry &entry )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+		return FindTarget( registry, target, entry );
+	}
+
+	bool HookRegistry::FindByTrampoline( const void *trampoline, Entry &entry )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+
+		const auto it = registry.trampolines.find( trampoline );
+		return it != registry.trampolines.end( ) && FindTarget( registry, it->second, entry );
+	}
+
+	bool HookRegistry::FindByDetour( const void *detour, Entry &entry )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+
+		const auto it = registry.detours.find( detour );
+		return it != registry.detours.end( ) && FindTarget( registry, it->second.front( ), entry );
+	}
+
+	bool HookRegistry::IsHooked( const void *target )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+		return registry.targets.count( target ) != 0;
+	}
+
+	size_t HookRegistry::GetSize( )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+		return registry.targets.size( );
+	}
+
+	void HookRegistry::ForEach( const std::function<void( const Entry & )> &callback )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+		for( const auto &pair : registry.targets )
+			callback( pair.second );
+	}
+
+	std::vector<HookRegistry::Entry> HookRegistry::GetEntries( )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+
+		std::vector<Entry> entries;
+		entries.reserve( registry.targets.size( ) );
+		for( const auto &pair : registry.targets )
+			entries.push_back( pair.second );
+
+		return entries;
+	}
+
+	void HookRegistry::Register( Hook &hook )
+	{
+		Registry &registry = GetRegistry( );
+		std::unique_lock lock( registry.mutex );
+
+		void *target = hook.GetTarget( );
+		registry.targets[target] = { &hook, target, hook.GetDetour( ), hook.GetTrampoline( ), false };
+		registry.trampolines[hook.GetTrampoline( )] = target;
+		registry.detours[hook.GetDetour( )].push_back( target );
+	}
+
+	void HookRegistry::Unregister( const Hook &hook )
+	{
+		Registry &registry = GetRegistry( );
+		std::unique_lock lock( registry.mutex );
+
+		void *target = hook.GetTarget( );
+		const auto it = registry.targets.find( target );
+		if( it == registry.targets.end( ) || it->second.hook != &hook )
+			return;
+
+		registry.trampolines.erase( it->second.trampoline );
+		RemoveDetour( registry, it->second.detour, target );
+		registry.targets.erase( it );
+	}
+
+	void HookRegistry::SetDetour( const Hook &hook, void *previous )
+	{
+		Registry &registry = GetRegistry( );
+		std::unique_lock lock( registry.mutex );
+
+		void *target = hook.GetTarget( );
+		const auto it = registry.targets.find( target );
+		if( it == registry.targets.end( ) || it->second.hook != &hook )
+			return;
+
+		RemoveDetour( registry, previous, target );
+		it->second.detour = hook.GetDetour( );
+		registry.detours[it->second.detour].push_back( target );
+	}
+
+	bool HookRegistry::IsEnabled( const void *target )
+	{
+		Registry &registry = GetRegistry( );
+		std::shared_lock lock( registry.mutex );
+
+		const auto it = registry.targets.find( target );
+		return it != registry.targets.end( ) && it->second.enabled;
+	}
+
+	void HookRegistry::SetEnabled( const void *target, bool enabled )
+	{
+		Registry &registry = GetRegistry( );
+		std::unique_lock lock( registry.mutex );
+
+		const auto it = registry.targets.find( target );
+		if( it != registry.targets.end( ) )
+			it->second.enabled = enabled;
+	}
+}
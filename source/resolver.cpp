@@ -0,0 +1,279 @@
+/*************************************************************************
+* Detouring::Resolver
+* A C++ class that resolves symbols and signatures of many modules in
+* parallel.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "resolver.hpp"
+#include "symbols.hpp"
+#include "module.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+namespace Detouring
+{
+	namespace
+	{
+		struct ModuleGroup
+		{
+			Hook::Module module;
+			ModuleInfo info;
+			std::vector<size_t> symbols;
+			std::vector<size_t> signatures;
+			SignatureSet signature_set;
+			std::vector<std::vector<void *>> chunk_results;
+		};
+
+		std::string GetModuleKey( const Hook::Module &module )
+		{
+			if( module.IsPointer( ) )
+				return std::to_string( reinterpret_cast<uintptr_t>( module.GetPointer( ) ) );
+
+			return GetModuleName( module );
+		}
+
+		void RunTasks( const std::vector<std::function<void( )>> &tasks, size_t thread_count )
+		{
+			std::atomic<size_t> next( 0 );
+			const auto worker = [&tasks, &next]( )
+			{
+				for( size_t k = next++; k < tasks.size( ); k = next++ )
+					tasks[k]( );
+			};
+
+			// The calling thread works as well
+			std::vector<std::thread> threads;
+			const size_t count = std::min( thread_count, tasks.size( ) );
+			for( size_t k = 1; k < count; ++k )
+				threads.emplace_back( worker );
+
+			worker( );
+
+			for( std::thread &thread : threads )
+				thread.join( );
+		}
+	}
+
+	Resolver::Resolver( size_t threads ) :
+		thread_count( threads != 0 ? threads : std::max( std::thread::hardware_concurrency( ), 1u ) )
+	{ }
+
+	size_t Resolver::AddSymbol( const Hook::Module &module, const std::string &name )
+	{
+		requests.push_back( { module, name, Signature( ), false } );
+		addresses.push_back( nullptr );
+		return requests.size( ) - 1;
+	}
+
+	size_t Resolver::AddSignature( const Hook::Module &module, const Signature &signature )
+	{
+		requests.push_back( { module, std::string( ), signature, true } );
+		addresses.push_back( nullptr );
+		return requests.size( ) - 1;
+	}
+
+	size_t Resolver::GetSize( ) const
+	{
+		return requests.size( );
+	}
+
+	size_t Resolver::GetThreadCount( ) const
+	{
+		return thread_count;
+	}
+
+	void Resolver::SetCache( ResolutionCache *resolution_cache )
+	{
+		cache = resolution_cache;
+	}
+
+	bool Resolver::Resolve( )
+	{
+		std::vector<std::unique_ptr<ModuleGroup>> groups;
+		std::unordered_map<std::string, ModuleGroup *> groups_by_key;
+		std::unordered_map<std::string, ModuleGroup *> groups_by_path;
+		const size_t first = resolved;
+		for( size_t id = first; id < requests.size( ); ++id )
+		{
+			const Request &request = requests[id];
+			if( cache != nullptr )
+			{
+				addresses[id] = request.is_signature ?
+					cache->FindSignature( request.module, request.signature ) :
+					cache->FindSymbol( request.module, request.symbol );
+				if( addresses[id] != nullptr )
+					continue;
+			}
+
+			const std::string key = GetModuleKey( request.module );
+
+			ModuleGroup *group = nullptr;
+			const auto it = groups_by_key.find( key );
+			if( it != groups_by_key.end( ) )
+			{
+				group = it->second;
+			}
+			else
+			{
+				ModuleInfo info;
+				if( GetModuleInfo( request.module, info ) )
+				{
+					// Different names can refer to the same module
+					const std::string path = info.path + '@' + std::to_string( info.base );
+					ModuleGroup *&existing = groups_by_path[path];
+					if( existing == nullptr )
+					{
+						groups.push_back( std::make_unique<ModuleGroup>( ) );
+						existing = groups.back( ).get( );
+						existing->module = request.module;
+						existing->info = std::move( info );
+					}
+
+					group = existing;
+				}
+
+				groups_by_key[key] = group;
+			}
+
+			if( group == nullptr )
+				continue;
+
+			if( request.is_signature )
+			{
+				group->signatures.push_back( id );
+				group->signature_set.Add( request.signature );
+			}
+			else
+			{
+				group->symbols.push_back( id );
+			}
+		}
+
+		resolved = requests.size( );
+
+		// Symbol tasks go first since building an index takes longer than scanning a chunk
+		std::vector<std::function<void( )>> tasks;
+		for( const auto &group : groups )
+			if( !group->symbols.empty( ) )
+				tasks.emplace_back( [this, group = group.get( )]( )
+				{
+					std::vector<std::string> names;
+					names.reserve( group->symbols.size( ) );
+					for( size_t id : group->symbols )
+						names.push_back( requests[id].symbol );
+
+					std::vector<void *> found;
+					const bool all = ResolveSymbols( group->module, names, found );
+
+					std::shared_ptr<const SymbolIndex> index;
+					for( size_t k = 0; k < group->symbols.size( ); ++k )
+					{
+						void *address = k < found.size( ) ? found[k] : nullptr;
+						if( address == nullptr && !all )
+						{
+							if( !index )
+								index = SymbolIndex::Get( group->module );
+
+							if( index )
+								address = index->Find( names[k] );
+						}
+
+						addresses[group->symbols[k]] = address;
+					}
+				} );
+
+		for( const auto &group : groups )
+		{
+			if( group->signatures.empty( ) )
+				continue;
+
+			group->signature_set.Compile( );
+
+			for( const MemoryRegion &segment : group->info.segments )
+			{
+				if( ( segment.protection & MemoryProtection::Execute ) == 0 )
+					continue;
+
+				const uint8_t *begin = reinterpret_cast<const uint8_t *>( segment.start );
+				const uint8_t *end = reinterpret_cast<const uint8_t *>( segment.end );
+				for( const uint8_t *from = begin; from < end; from += std::min<size_t>( ChunkSize, end - from ) )
+				{
+					const size_t chunk = group->chunk_results.size( );
+					group->chunk_results.emplace_back( );
+					tasks.emplace_back( [group = group.get( ), chunk, begin, end, from]( )
+					{
+						const uint8_t *to = from + std::min<size_t>( ChunkSize, end - from );
+						group->signature_set.Scan( begin, end, from, to, group->chunk_results[chunk] );
+					} );
+				}
+			}
+		}
+
+		RunTasks( tasks, thread_count );
+
+		// Chunks are scanned independently, so keep the lowest match of each signature
+		for( const auto &group : groups )
+			for( const std::vector<void *> &results : group->chunk_results )
+				for( size_t k = 0; k < results.size( ); ++k )
+				{
+					void *&address = addresses[group->signatures[k]];
+					if( results[k] != nullptr && ( address == nullptr || results[k] < address ) )
+						address = results[k];
+				}
+
+		if( cache != nullptr )
+			for( const auto &group : groups )
+			{
+				for( size_t id : group->symbols )
+					if( addresses[id] != nullptr )
+						cache->AddSymbol( group->module, requests[id].symbol, addresses[id] );
+
+				for( size_t id : group->signatures )
+					if( addresses[id] != nullptr )
+						cache->AddSignature( group->module, requests[id].signature, addresses[id] );
+			}
+
+		// Earlier calls already reported on their own requests
+		return std::find( addresses.begin( ) + first, addresses.end( ), nullptr ) == addresses.end( );
+	}
+
+	void *Resolver::GetAddress( size_t id ) const
+	{
+		return id < addresses.size( ) ? addresses[id] : nullptr;
+	}
+}
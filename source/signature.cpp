@@ -0,0 +1,605 @@
+/*************************************************************************
+* Detouring::Signature
+* A C++ class that searches module code for byte patterns with
+* wildcards.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "signature.hpp"
+#include "platform.hpp"
+#include "module.hpp"
+
+#include <cstring>
+
+#if defined ARCHITECTURE_X86_64 || defined __SSE2__ || ( defined _M_IX86_FP && _M_IX86_FP >= 2 )
+
+#define DETOURING_SIGNATURE_SSE2 1
+
+#include <immintrin.h>
+
+#ifdef COMPILER_VC
+
+#include <intrin.h>
+
+#define DETOURING_TARGET_AVX2
+
+#else
+
+#define DETOURING_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+
+#endif
+
+#endif
+
+namespace Detouring
+{
+	struct Pattern
+	{
+		const uint8_t *bytes;
+		const uint8_t *mask;
+		size_t size;
+		size_t anchor_offset;
+		uint8_t anchor;
+		size_t second_anchor_offset;
+		uint8_t second_anchor;
+
+		bool Matches( const uint8_t *address ) const
+		{
+			for( size_t k = 0; k < size; ++k )
+				if( ( address[k] & mask[k] ) != bytes[k] )
+					return false;
+
+			return true;
+		}
+	};
+
+	static const uint8_t *FindScalar( const Pattern &pattern, const uint8_t *start, const uint8_t *last )
+	{
+		while( start <= last )
+		{
+			const void *hit = std::memchr(
+				start + pattern.anchor_offset,
+				pattern.anchor,
+				static_cast<size_t>( last - start ) + 1
+			);
+			if( hit == nullptr )
+				return nullptr;
+
+			start = static_cast<const uint8_t *>( hit ) - pattern.anchor_offset;
+			if( pattern.Matches( start ) )
+				return start;
+
+			++start;
+		}
+
+		return nullptr;
+	}
+
+#ifdef DETOURING_SIGNATURE_SSE2
+
+	static inline uint32_t CountTrailingZeros( uint32_t value )
+	{
+
+#ifdef COMPILER_VC
+
+		unsigned long index = 0;
+		_BitScanForward( &index, value );
+		return static_cast<uint32_t>( index );
+
+#else
+
+		return static_cast<uint32_t>( __builtin_ctz( value ) );
+
+#endif
+
+	}
+
+	static bool HasAVX2( )
+	{
+
+#ifdef COMPILER_VC
+
+		int info[4] = { 0 };
+		__cpuid( info, 0 );
+		if( info[0] < 7 )
+			return false;
+
+		// The OS must save the YMM registers too
+		__cpuid( info, 1 );
+		if( ( info[2] & ( 1 << 27 ) ) == 0 || ( info[2] & ( 1 << 28 ) ) == 0 || ( _xgetbv( 0 ) & 6 ) != 6 )
+			return false;
+
+		__cpuidex( info, 7, 0 );
+		return ( info[1] & ( 1 << 5 ) ) != 0;
+
+#else
+
+		return __builtin_cpu_supports( "avx2" );
+
+#endif
+
+	}
+
+	static const uint8_t *FindSSE2( const Pattern &pattern, const uint8_t *start, const uint8_t *last )
+	{
+		const __m128i anchor = _mm_set1_epi8( static_cast<char>( pattern.anchor ) );
+		const __m128i second_anchor = _mm_set1_epi8( static_cast<char>( pattern.second_anchor ) );
+		for( ; static_cast<size_t>( last - start ) >= 15; start += 16 )
+		{
+			const __m128i first = _mm_cmpeq_epi8( _mm_loadu_si128(
+				reinterpret_cast<const __m128i *>( start + pattern.anchor_offset )
+			), anchor );
+			const __m128i second = _mm_cmpeq_epi8( _mm_loadu_si128(
+				reinterpret_cast<const __m128i *>( start + pattern.second_anchor_offset )
+			), second_anchor );
+
+			uint32_t candidates = static_cast<uint32_t>( _mm_movemask_epi8( _mm_and_si128( first, second ) ) );
+			for( ; candidates != 0; candidates &= candidates - 1 )
+			{
+				const uint8_t *candidate = start + CountTrailingZeros( candidates );
+				if( pattern.Matches( candidate ) )
+					return candidate;
+			}
+		}
+
+		return FindScalar( pattern, start, last );
+	}
+
+	DETOURING_TARGET_AVX2
+	static const uint8_t *FindAVX2( const Pattern &pattern, const uint8_t *start, const uint8_t *last )
+	{
+		const __m256i anchor = _mm256_set1_epi8( static_cast<char>( pattern.anchor ) );
+		const __m256i second_anchor = _mm256_set1_epi8( static_cast<char>( pattern.second_anchor ) );
+		for( ; static_cast<size_t>( last - start ) >= 31; start += 32 )
+		{
+			const __m256i first = _mm256_cmpeq_epi8( _mm256_loadu_si256(
+				reinterpret_cast<const __m256i *>( start + pattern.anchor_offset )
+			), anchor );
+			const __m256i second = _mm256_cmpeq_epi8( _mm256_loadu_si256(
+				reinterpret_cast<const __m256i *>( start + pattern.second_anchor_offset )
+			), second_anchor );
+
+			uint32_t candidates = static_cast<uint32_t>( _mm256_movemask_epi8( _mm256_and_si256( first, second ) ) );
+			for( ; candidates != 0; candidates &= candidates - 1 )
+			{
+				const uint8_t *candidate = start + CountTrailingZeros( candidates );
+				if( pattern.Matches( candidate ) )
+					return candidate;
+			}
+		}
+
+		return FindSSE2( pattern, start, last );
+	}
+
+#endif
+
+	static int ParseHexadecimalDigit( char digit )
+	{
+		if( digit >= '0' && digit <= '9' )
+			return digit - '0';
+
+		if( digit >= 'a' && digit <= 'f' )
+			return digit - 'a' + 10;
+
+		if( digit >= 'A' && digit <= 'F' )
+			return digit - 'A' + 10;
+
+		return -1;
+	}
+
+	uint8_t GetByteFrequency( uint8_t byte )
+	{
+		// Most common bytes in x86 and x86-64 code, from most to least common
+		static const uint8_t common_bytes[] = {
+			0x00, 0xFF, 0x48, 0x8B, 0x89, 0x24, 0xE8, 0x0F, 0x4C, 0x44, 0x8D, 0x85, 0x01, 0x45, 0x83, 0x74,
+			0x75, 0x49, 0x41, 0xC7, 0x04, 0x08, 0x10, 0xC3, 0xCC, 0x90, 0x5D, 0x55, 0x53, 0x5B, 0xEB, 0x84,
+			0xC0, 0x20, 0x18, 0x40, 0x28, 0x30, 0x38, 0x50, 0x58, 0x02, 0x03, 0xF8, 0xE0, 0x80, 0x66, 0x0C,
+			0x14, 0x1C, 0x3C, 0x7C, 0xC4, 0xEC, 0x39, 0x3B, 0x31, 0x33, 0x29, 0x2B, 0x5E, 0x5F, 0x56, 0x57
+		};
+
+		static const auto frequencies = []
+		{
+			std::vector<uint8_t> values( 256, 0 );
+			for( size_t k = 0; k < sizeof( common_bytes ); ++k )
+				values[common_bytes[k]] = static_cast<uint8_t>( 255 - k );
+
+			return values;
+		}( );
+
+		return frequencies[byte];
+	}
+
+	Signature::Signature( const char *pattern ) :
+		Signature( std::string( pattern != nullptr ? pattern : "" ) ) { }
+
+	Signature::Signature( const std::string &pattern )
+	{
+		for( size_t k = 0; k < pattern.size( ); )
+		{
+			const char character = pattern[k];
+			if( character == ' ' )
+			{
+				++k;
+				continue;
+			}
+
+			if( character == '?' )
+			{
+				k += k + 1 < pattern.size( ) && pattern[k + 1] == '?' ? 2 : 1;
+				bytes.push_back( 0x00 );
+				mask.push_back( 0x00 );
+				continue;
+			}
+
+			const int high = ParseHexadecimalDigit( character );
+			const int low = k + 1 < pattern.size( ) ? ParseHexadecimalDigit( pattern[k + 1] ) : -1;
+			if( high == -1 || low == -1 )
+			{
+				bytes.clear( );
+				mask.clear( );
+				return;
+			}
+
+			bytes.push_back( static_cast<uint8_t>( ( high << 4 ) | low ) );
+			mask.push_back( 0xFF );
+			k += 2;
+		}
+
+		Prepare( );
+	}
+
+	Signature::Signature( const char *_bytes, const char *_mask )
+	{
+		if( _bytes == nullptr || _mask == nullptr )
+			return;
+
+		for( size_t k = 0; _mask[k] != '\0'; ++k )
+		{
+			const bool wildcard = _mask[k] == '?';
+			bytes.push_back( wildcard ? 0x00 : static_cast<uint8_t>( _bytes[k] ) );
+			mask.push_back( wildcard ? 0x00 : 0xFF );
+		}
+
+		Prepare( );
+	}
+
+	bool Signature::IsValid( ) const
+	{
+		return !bytes.empty( ) && mask[anchor_offset] != 0x00;
+	}
+
+	size_t Signature::GetSize( ) const
+	{
+		return bytes.size( );
+	}
+
+	const std::vector<uint8_t> &Signature::GetBytes( ) const
+	{
+		return bytes;
+	}
+
+	const std::vector<uint8_t> &Signature::GetMask( ) const
+	{
+		return mask;
+	}
+
+	size_t Signature::GetAnchorOffset( ) const
+	{
+		return anchor_offset;
+	}
+
+	uint8_t Signature::GetAnchor( ) const
+	{
+		return bytes.empty( ) ? 0 : bytes[anchor_offset];
+	}
+
+	bool Signature::Matches( const uint8_t *address ) const
+	{
+		if( !IsValid( ) || address == nullptr )
+			return false;
+
+		for( size_t k = 0; k < bytes.size( ); ++k )
+			if( ( address[k] & mask[k] ) != bytes[k] )
+				return false;
+
+		return true;
+	}
+
+	const uint8_t *Signature::Find( const uint8_t *begin, const uint8_t *end ) const
+	{
+		if( !IsValid( ) || begin == nullptr || end < begin || static_cast<size_t>( end - begin ) < bytes.size( ) )
+			return nullptr;
+
+		const Pattern pattern = {
+			bytes.data( ),
+			mask.data( ),
+			bytes.size( ),
+			anchor_offset,
+			bytes[anchor_offset],
+			second_anchor_offset,
+			bytes[second_anchor_offset]
+		};
+		const uint8_t *last = end - bytes.size( );
+
+#ifdef DETOURING_SIGNATURE_SSE2
+
+		static const bool has_avx2 = HasAVX2( );
+		return has_avx2 ? FindAVX2( pattern, begin, last ) : FindSSE2( pattern, begin, last );
+
+#else
+
+		return FindScalar( pattern, begin, last );
+
+#endif
+
+	}
+
+	void Signature::Prepare( )
+	{
+		anchor_offset = second_anchor_offset = 0;
+		for( size_t k = 0; k < bytes.size( ); ++k )
+			if(
+				mask[k] != 0x00 &&
+				( mask[anchor_offset] == 0x00 || GetByteFrequency( bytes[k] ) < GetByteFrequency( bytes[anchor_offset] ) )
+			)
+				anchor_offset = k;
+
+		second_anchor_offset = anchor_offset;
+		for( size_t k = 0; k < bytes.size( ); ++k )
+			if(
+				k != anchor_offset &&
+				mask[k] != 0x00 &&
+				(
+					second_anchor_offset == anchor_offset ||
+					GetByteFrequency( bytes[k] ) < GetByteFrequency( bytes[second_anchor_offset] )
+				)
+			)
+				second_anchor_offset = k;
+	}
+
+	void *FindSignature( const Hook::Module &module, const Signature &signature )
+	{
+		ModuleInfo info;
+		if( !signature.IsValid( ) || !GetModuleInfo( module, info ) )
+			return nullptr;
+
+		for( const MemoryRegion &segment : info.segments )
+		{
+			if( ( segment.protection & MemoryProtection::Execute ) == 0 )
+				continue;
+
+			const uint8_t *match = signature.Find(
+				reinterpret_cast<const uint8_t *>( segment.start ),
+				reinterpret_cast<const uint8_t *>( segment.end )
+			);
+			if( match != nullptr )
+				return const_cast<uint8_t *>( match );
+		}
+
+		return nullptr;
+	}
+
+	std::vector<void *> FindSignatureMatches( const Hook::Module &module, const Signature &signature )
+	{
+		std::vector<void *> matches;
+
+		ModuleInfo info;
+		if( !signature.IsValid( ) || !GetModuleInfo( module, info ) )
+			return matches;
+
+		for( const MemoryRegion &segment : info.segments )
+		{
+			if( ( segment.protection & MemoryProtection::Execute ) == 0 )
+				continue;
+
+			const uint8_t *end = reinterpret_cast<const uint8_t *>( segment.end );
+			for(
+				const uint8_t *match = signature.Find( reinterpret_cast<const uint8_t *>( segment.start ), end );
+				match != nullptr;
+				match = signature.Find( match + 1, end )
+			)
+				matches.push_back( const_cast<uint8_t *>( match ) );
+		}
+
+		return matches;
+	}
+
+	size_t SignatureSet::Add( const Signature &signature )
+	{
+		signatures.push_back( signature );
+		compiled = false;
+		return signatures.size( ) - 1;
+	}
+
+	size_t SignatureSet::GetSize( ) const
+	{
+		return signatures.size( );
+	}
+
+	const Signature &SignatureSet::Get( size_t id ) const
+	{
+		return signatures[id];
+	}
+
+	void SignatureSet::Compile( )
+	{
+		std::vector<std::pair<uint32_t, Entry>> pairs, singles;
+		for( size_t id = 0; id < signatures.size( ); ++id )
+		{
+			const Signature &signature = signatures[id];
+			if( !signature.IsValid( ) )
+				continue;
+
+			const std::vector<uint8_t> &bytes = signature.GetBytes( );
+			const std::vector<uint8_t> &mask = signature.GetMask( );
+
+			size_t best = bytes.size( );
+			uint32_t best_frequency = ~0u;
+			for( size_t k = 0; k + 1 < bytes.size( ); ++k )
+			{
+				if( mask[k] == 0x00 || mask[k + 1] == 0x00 )
+					continue;
+
+				const uint32_t frequency = GetByteFrequency( bytes[k] ) + GetByteFrequency( bytes[k + 1] );
+				if( frequency < best_frequency )
+				{
+					best = k;
+					best_frequency = frequency;
+				}
+			}
+
+			if( best != bytes.size( ) )
+				pairs.push_back( {
+					static_cast<uint32_t>( bytes[best] | ( bytes[best + 1] << 8 ) ),
+					{ static_cast<uint32_t>( id ), static_cast<uint32_t>( best ) }
+				} );
+			else
+				singles.push_back( {
+					signature.GetAnchor( ),
+					{ static_cast<uint32_t>( id ), static_cast<uint32_t>( signature.GetAnchorOffset( ) ) }
+				} );
+		}
+
+		const auto build = []( const std::vector<std::pair<uint32_t, Entry>> &keyed, size_t count,
+			std::vector<uint32_t> &buckets, std::vector<Entry> &entries )
+		{
+			buckets.assign( count + 1, 0 );
+			for( const auto &pair : keyed )
+				++buckets[pair.first + 1];
+
+			for( size_t k = 1; k <= count; ++k )
+				buckets[k] += buckets[k - 1];
+
+			entries.resize( keyed.size( ) );
+			std::vector<uint32_t> cursors( buckets.begin( ), buckets.end( ) - 1 );
+			for( const auto &pair : keyed )
+				entries[cursors[pair.first]++] = pair.second;
+		};
+
+		build( pairs, 0x10000, pair_buckets, pair_entries );
+		build( singles, 0x100, single_buckets, single_entries );
+
+		pair_filter.assign( 0x10000 / 64, 0 );
+		for( const auto &pair : pairs )
+			pair_filter[pair.first / 64] |= static_cast<uint64_t>( 1 ) << ( pair.first % 64 );
+
+		compiled = true;
+	}
+
+	size_t SignatureSet::Scan(
+		const uint8_t *begin,
+		const uint8_t *end,
+		const uint8_t *from,
+		const uint8_t *to,
+		std::vector<void *> &results
+	) const
+	{
+		results.resize( signatures.size( ), nullptr );
+		if( !compiled || begin == nullptr || end <= begin )
+			return 0;
+
+		size_t remaining = 0;
+		for( size_t id = 0; id < signatures.size( ); ++id )
+			if( results[id] == nullptr && signatures[id].IsValid( ) )
+				++remaining;
+
+		if( from < begin )
+			from = begin;
+
+		if( to > end )
+			to = end;
+
+		const auto check = [this, begin, end, &results, &remaining]( const uint8_t *position, const Entry &entry )
+		{
+			if( results[entry.id] != nullptr || static_cast<size_t>( position - begin ) < entry.offset )
+				return;
+
+			const Signature &signature = signatures[entry.id];
+			const uint8_t *start = position - entry.offset;
+			if( static_cast<size_t>( end - start ) < signature.GetSize( ) || !signature.Matches( start ) )
+				return;
+
+			results[entry.id] = const_cast<uint8_t *>( start );
+			--remaining;
+		};
+
+		const size_t total = remaining;
+		const uint64_t *filter = pair_filter.data( );
+		const uint32_t *buckets = pair_buckets.data( );
+		const bool has_singles = !single_entries.empty( );
+		for( const uint8_t *position = from; position < to && remaining != 0; ++position )
+		{
+			if( has_singles )
+				for( uint32_t k = single_buckets[position[0]]; k < single_buckets[position[0] + 1u]; ++k )
+					check( position, single_entries[k] );
+
+			if( end - position < 2 )
+				break;
+
+			const uint32_t key = static_cast<uint32_t>( position[0] | ( position[1] << 8 ) );
+			if( ( filter[key / 64] >> ( key % 64 ) & 1 ) == 0 )
+				continue;
+
+			for( uint32_t k = buckets[key]; k < buckets[key + 1]; ++k )
+				check( position, pair_entries[k] );
+		}
+
+		return total - remaining;
+	}
+
+	size_t SignatureSet::Scan( const uint8_t *begin, const uint8_t *end, std::vector<void *> &results ) const
+	{
+		return Scan( begin, end, begin, end, results );
+	}
+
+	std::vector<void *> SignatureSet::Scan( const Hook::Module &module )
+	{
+		std::vector<void *> results( signatures.size( ), nullptr );
+
+		ModuleInfo info;
+		if( !GetModuleInfo( module, info ) )
+			return results;
+
+		if( !compiled )
+			Compile( );
+
+		for( const MemoryRegion &segment : info.segments )
+			if( ( segment.protection & MemoryProtection::Execute ) != 0 )
+				Scan(
+					reinterpret_cast<const uint8_t *>( segment.start ),
+					reinterpret_cast<const uint8_t *>( segment.end ),
+					results
+				);
+
+		return results;
+	}
+}
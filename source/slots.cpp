@@ -0,0 +1,74 @@
+/*************************************************************************
+* Detouring::WriteSlots
+* Internal batched pointer writes into possibly read-only pages.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "slots.hpp"
+#include "helpers.hpp"
+#include "platform.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Detouring
+{
+	bool WriteSlots( void **const *slots, void *const *values, size_t count )
+	{
+		if( count == 0 )
+			return true;
+
+		WritableScope scope;
+		for( size_t k = 0; k < count; ++k )
+			scope.Add( slots[k], sizeof( void * ) );
+
+		bool written = scope.Apply( );
+
+		// Read back from the map Apply refreshed, so slots left unmapped or
+		// read only are skipped instead of faulting
+		std::vector<int32_t> protections( count );
+		written = GetMemoryProtection(
+			reinterpret_cast<void *const *>( slots ),
+			count,
+			protections.data( )
+		) && written;
+
+		// Aligned pointer stores are atomic, so callers see either address
+		for( size_t k = 0; k < count; ++k )
+			if( protections[k] >= MemoryProtection::None && ( protections[k] & MemoryProtection::Write ) != 0 )
+				*static_cast<void *volatile *>( slots[k] ) = values[k];
+			else
+				written = false;
+
+		return written;
+	}
+}
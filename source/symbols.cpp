@@ -0,0 +1,698 @@
+/*************************************************************************
+* Detouring::SymbolIndex
+* A C++ class that indexes every named symbol of a module, including
+* the ones that are not exported.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "symbols.hpp"
+#include "platform.hpp"
+#include "module.hpp"
+#include "elf.hpp"
+#include "mappedfile.hpp"
+
+#include <cstring>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined SYSTEM_WINDOWS
+
+#define WIN32_LEAN_AND_MEAN
+
+#include <Windows.h>
+
+#elif defined SYSTEM_POSIX
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <dlfcn.h>
+
+#endif
+
+namespace Detouring
+{
+
+#if defined SYSTEM_LINUX
+
+	struct DebugLink
+	{
+		std::string name;
+		uint32_t crc = 0;
+		std::string build_id;
+	};
+
+	static uint32_t GetCRC32( const uint8_t *data, size_t size )
+	{
+		static const auto table = [] {
+			std::vector<uint32_t> values( 256 );
+			for( uint32_t k = 0; k < 256; ++k )
+			{
+				uint32_t value = k;
+				for( int bit = 0; bit < 8; ++bit )
+					value = ( value & 1 ) != 0 ? 0xEDB88320 ^ ( value >> 1 ) : value >> 1;
+
+				values[k] = value;
+			}
+
+			return values;
+		}( );
+
+		uint32_t crc = 0xFFFFFFFF;
+		for( size_t k = 0; k < size; ++k )
+			crc = table[( crc ^ data[k] ) & 0xFF] ^ ( crc >> 8 );
+
+		return crc ^ 0xFFFFFFFF;
+	}
+
+	struct IndirectSymbol
+	{
+		size_t index;
+		void *resolver;
+		std::string path;
+	};
+
+	struct SymbolSearch
+	{
+		bool all;
+		uintptr_t base;
+		const std::vector<std::string> &names;
+		const std::vector<uint32_t> &hashes;
+		std::vector<void *> &addresses;
+		std::vector<IndirectSymbol> indirect;
+		size_t remaining;
+	};
+
+	// Runs under the loader lock, so no module is unloaded while its tables
+	// are read. IFUNC resolvers are called afterwards, outside of it.
+	static int ResolveInModule( dl_phdr_info *phdr, size_t, void *data )
+	{
+		SymbolSearch &search = *static_cast<SymbolSearch *>( data );
+		if( search.remaining == 0 )
+			return 1;
+
+		if( !search.all && static_cast<uintptr_t>( phdr->dlpi_addr ) != search.base )
+			return 0;
+
+		// The vDSO is not part of the global lookup scope that dlsym uses
+		const char *path = phdr->dlpi_name != nullptr ? phdr->dlpi_name : "";
+		if( search.all && path[0] != '\0' && std::strchr( path, '/' ) == nullptr )
+			return 0;
+
+		DynamicInfo info;
+		if( !GetDynamicInfo( *phdr, info ) )
+			return 0;
+
+		for( size_t k = 0; k < search.names.size( ); ++k )
+		{
+			if( search.addresses[k] != nullptr )
+				continue;
+
+			const ElfW( Sym ) *symbol = FindDynamicSymbol( info, search.names[k].c_str( ), search.hashes[k] );
+			if( symbol == nullptr )
+				continue;
+
+			void *address = reinterpret_cast<void *>( info.base + symbol->st_value );
+			if( DETOURING_ELF_ST_TYPE( symbol->st_info ) == STT_GNU_IFUNC )
+				search.indirect.push_back( { k, address, path } );
+
+			search.addresses[k] = address;
+			--search.remaining;
+		}
+
+		return 0;
+	}
+
+	// Whether the entry names something defined in the module
+	static bool IsIndexable( const ElfW( Sym ) &symbol, const char *strings, size_t strings_size )
+	{
+		if(
+			symbol.st_name == 0 ||
+			symbol.st_name >= strings_size ||
+			symbol.st_shndx == SHN_UNDEF ||
+			symbol.st_shndx == SHN_ABS ||
+			symbol.st_value == 0
+		)
+			return false;
+
+		const uint8_t type = DETOURING_ELF_ST_TYPE( symbol.st_info );
+		if( type != STT_FUNC && type != STT_OBJECT && type != STT_GNU_IFUNC && type != STT_NOTYPE )
+			return false;
+
+		return std::memchr( strings + symbol.st_name, '\0', strings_size - symbol.st_name ) != nullptr;
+	}
+
+	// Looks for the name in the symbol tables of the file alone, without
+	// building an index or looking for its debug companion
+	static bool HasSymbol( const std::string &file_path, const std::string &name )
+	{
+		MappedFile file( file_path );
+		const ElfW( Ehdr ) *header = file.Get<ElfW( Ehdr )>( 0 );
+		if(
+			header == nullptr ||
+			std::memcmp( header->e_ident, ELFMAG, SELFMAG ) != 0 ||
+			header->e_ident[EI_CLASS] != DETOURING_ELF_CLASS ||
+			header->e_shentsize != sizeof( ElfW( Shdr ) )
+		)
+			return false;
+
+		const ElfW( Shdr ) *sections = file.Get<ElfW( Shdr )>( header->e_shoff, header->e_shnum );
+		for( size_t k = 0; sections != nullptr && k < header->e_shnum; ++k )
+		{
+			const ElfW( Shdr ) &section = sections[k];
+			if( ( section.sh_type != SHT_SYMTAB && section.sh_type != SHT_DYNSYM ) || section.sh_link >= header->e_shnum )
+				continue;
+
+			const ElfW( Shdr ) &strings_section = sections[section.sh_link];
+			const char *strings = file.Get<char>( strings_section.sh_offset, strings_section.sh_size );
+			const size_t count = section.sh_size / sizeof( ElfW( Sym ) );
+			const ElfW( Sym ) *symbols = file.Get<ElfW( Sym )>( section.sh_offset, count );
+			if( strings == nullptr || symbols == nullptr )
+				continue;
+
+			for( size_t s = 0; s < count; ++s )
+				if( IsIndexable( symbols[s], strings, strings_section.sh_size ) && name == strings + symbols[s].st_name )
+					return true;
+		}
+
+		return false;
+	}
+
+	static std::string ToHexadecimal( const std::string &bytes )
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string hexadecimal;
+		for( const char byte : bytes )
+		{
+			hexadecimal += digits[( static_cast<uint8_t>( byte ) >> 4 ) & 0xF];
+			hexadecimal += digits[static_cast<uint8_t>( byte ) & 0xF];
+		}
+
+		return hexadecimal;
+	}
+
+#endif
+
+	struct SymbolIndices
+	{
+		std::mutex mutex;
+		std::unordered_map<std::string, std::shared_ptr<const SymbolIndex>> indices;
+
+		// Names FindInAllModules already looked for in modules without an
+		// index, keyed by module and build, so a rebuilt one is read again
+		std::unordered_map<std::string, std::unordered_set<std::string>> missing;
+	};
+
+	static SymbolIndices &GetSymbolIndices( )
+	{
+		static SymbolIndices indices;
+		return indices;
+	}
+
+	static std::string GetIndexKey( const ModuleInfo &info )
+	{
+		return info.path + '@' + std::to_string( info.base );
+	}
+
+	SymbolIndex::SymbolIndex( const Hook::Module &module )
+	{
+		Build( module );
+	}
+
+	bool SymbolIndex::Build( const Hook::Module &module )
+	{
+		const auto start = std::chrono::steady_clock::now( );
+
+		path.clear( );
+		base = 0;
+		size = 0;
+		entries.clear( );
+		names.assign( 1, '\0' );
+
+		ModuleInfo info;
+		if( !GetModuleInfo( module, info ) )
+			return false;
+
+		path = info.path;
+		base = info.base;
+		const bool success = Load( path, false );
+
+		build_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now( ) - start
+		);
+		return success && size != 0;
+	}
+
+	bool SymbolIndex::IsValid( ) const
+	{
+		return size != 0;
+	}
+
+	size_t SymbolIndex::GetSize( ) const
+	{
+		return size;
+	}
+
+	const std::string &SymbolIndex::GetPath( ) const
+	{
+		return path;
+	}
+
+	std::chrono::nanoseconds SymbolIndex::GetBuildTime( ) const
+	{
+		return build_time;
+	}
+
+	void *SymbolIndex::Find( const std::string &name ) const
+	{
+		if( entries.empty( ) )
+			return nullptr;
+
+		const uint32_t hash = GetGNUHash( name.c_str( ) );
+		const size_t mask = entries.size( ) - 1;
+		for( size_t k = hash & mask; entries[k].name != 0; k = ( k + 1 ) & mask )
+		{
+			const Entry &entry = entries[k];
+			if( entry.hash == hash && name == names.c_str( ) + entry.name )
+				return reinterpret_cast<void *>( entry.address );
+		}
+
+		return nullptr;
+	}
+
+	std::shared_ptr<const SymbolIndex> SymbolIndex::Get( const Hook::Module &module )
+	{
+		SymbolIndices &cache = GetSymbolIndices( );
+
+		ModuleInfo info;
+		if( !GetModuleInfo( module, info ) )
+			return nullptr;
+
+		const std::string key = GetIndexKey( info );
+
+		{
+			std::lock_guard lock( cache.mutex );
+
+			const auto it = cache.indices.find( key );
+			if( it != cache.indices.end( ) )
+				return it->second;
+		}
+
+		// Built without holding the lock so different modules can be indexed in parallel
+		auto index = std::make_shared<SymbolIndex>( module );
+		if( !index->IsValid( ) )
+			return nullptr;
+
+		std::lock_guard lock( cache.mutex );
+		return cache.indices.emplace( key, std::move( index ) ).first->second;
+	}
+
+	void *SymbolIndex::FindInAllModules( const std::string &name )
+	{
+		SymbolIndices &cache = GetSymbolIndices( );
+		const std::vector<ModuleInfo> modules = GetLoadedModules( );
+		for( const ModuleInfo &info : modules )
+		{
+			std::shared_ptr<const SymbolIndex> index;
+			const std::string key = GetIndexKey( info ) + '#' + info.build_id;
+
+			{
+				std::lock_guard lock( cache.mutex );
+				const auto it = cache.indices.find( GetIndexKey( info ) );
+				if( it != cache.indices.end( ) )
+					index = it->second;
+				else if( cache.missing[key].count( name ) != 0 )
+					continue;
+			}
+
+#if defined SYSTEM_LINUX
+
+			// Only a module holding the name gets an index built, so a miss
+			// never reads every debug companion
+			if( !index && HasSymbol( info.path, name ) )
+				index = Get( Hook::Module( info.path ) );
+
+#endif
+
+			if( !index )
+			{
+				std::lock_guard lock( cache.mutex );
+				cache.missing[key].insert( name );
+				continue;
+			}
+
+			void *address = index->Find( name );
+			if( address != nullptr )
+				return address;
+		}
+
+		// Forget the modules that were unloaded since
+		std::lock_guard lock( cache.mutex );
+		if( cache.missing.size( ) > modules.size( ) )
+		{
+			std::unordered_set<std::string> loaded;
+			for( const ModuleInfo &info : modules )
+				loaded.insert( GetIndexKey( info ) + '#' + info.build_id );
+
+			for( auto it = cache.missing.begin( ); it != cache.missing.end( ); )
+				if( loaded.count( it->first ) == 0 )
+					it = cache.missing.erase( it );
+				else
+					++it;
+		}
+
+		return nullptr;
+	}
+
+	bool SymbolIndex::Insert( const char *name, uintptr_t address, bool global )
+	{
+		if( ( size + 1 ) * 2 > entries.size( ) )
+			Rehash( entries.empty( ) ? 1024 : entries.size( ) * 2 );
+
+		const uint32_t hash = GetGNUHash( name );
+		const size_t mask = entries.size( ) - 1;
+		for( size_t k = hash & mask; ; k = ( k + 1 ) & mask )
+		{
+			Entry &entry = entries[k];
+			if( entry.name == 0 )
+			{
+				entry.address = address;
+				entry.name = static_cast<uint32_t>( names.size( ) );
+				entry.hash = hash;
+				entry.global = global;
+				names.append( name, std::strlen( name ) + 1 );
+				++size;
+				return true;
+			}
+
+			if( entry.hash == hash && std::strcmp( names.c_str( ) + entry.name, name ) == 0 )
+			{
+				// Exported definitions take precedence over local ones with the same name
+				if( global && !entry.global )
+				{
+					entry.address = address;
+					entry.global = true;
+				}
+
+				return false;
+			}
+		}
+	}
+
+	void SymbolIndex::Rehash( size_t capacity )
+	{
+		std::vector<Entry> previous( capacity, Entry { 0, 0, 0, false } );
+		previous.swap( entries );
+
+		const size_t mask = capacity - 1;
+		for( const Entry &entry : previous )
+		{
+			if( entry.name == 0 )
+				continue;
+
+			size_t k = entry.hash & mask;
+			while( entries[k].name != 0 )
+				k = ( k + 1 ) & mask;
+
+			entries[k] = entry;
+		}
+	}
+
+	bool SymbolIndex::Load( const std::string &file_path, bool is_debug_file )
+	{
+
+#if defined SYSTEM_LINUX
+
+		MappedFile file( file_path );
+		const ElfW( Ehdr ) *header = file.Get<ElfW( Ehdr )>( 0 );
+		if(
+			header == nullptr ||
+			std::memcmp( header->e_ident, ELFMAG, SELFMAG ) != 0 ||
+			header->e_ident[EI_CLASS] != DETOURING_ELF_CLASS ||
+			header->e_shentsize != sizeof( ElfW( Shdr ) )
+		)
+			return false;
+
+		const ElfW( Shdr ) *sections = file.Get<ElfW( Shdr )>( header->e_shoff, header->e_shnum );
+		if( sections == nullptr || header->e_shstrndx >= header->e_shnum )
+			return false;
+
+		const ElfW( Shdr ) &section_names = sections[header->e_shstrndx];
+		const char *section_strings = file.Get<char>( section_names.sh_offset, section_names.sh_size );
+
+		DebugLink debug_link;
+		for( size_t k = 0; k < header->e_shnum; ++k )
+		{
+			const ElfW( Shdr ) &section = sections[k];
+
+			if( section.sh_type == SHT_NOTE )
+			{
+				const uint8_t *notes = file.Get<uint8_t>( section.sh_offset, section.sh_size );
+				if( notes != nullptr && debug_link.build_id.empty( ) )
+					GetBuildId( notes, section.sh_size, debug_link.build_id );
+
+				continue;
+			}
+
+			if(
+				!is_debug_file &&
+				section.sh_type == SHT_PROGBITS &&
+				section_strings != nullptr &&
+				section.sh_name < section_names.sh_size &&
+				std::strcmp( section_strings + section.sh_name, ".gnu_debuglink" ) == 0
+			)
+			{
+				const char *link = file.Get<char>( section.sh_offset, section.sh_size );
+				if( link == nullptr )
+					continue;
+
+				const size_t length = strnlen( link, section.sh_size );
+				const size_t crc_offset = ( length + 4 ) & ~static_cast<size_t>( 3 );
+				if( crc_offset + sizeof( uint32_t ) <= section.sh_size )
+				{
+					debug_link.name.assign( link, length );
+					std::memcpy( &debug_link.crc, link + crc_offset, sizeof( uint32_t ) );
+				}
+
+				continue;
+			}
+
+			if( ( section.sh_type != SHT_SYMTAB && section.sh_type != SHT_DYNSYM ) || section.sh_link >= header->e_shnum )
+				continue;
+
+			const ElfW( Shdr ) &strings_section = sections[section.sh_link];
+			const char *strings = file.Get<char>( strings_section.sh_offset, strings_section.sh_size );
+			const size_t count = section.sh_size / sizeof( ElfW( Sym ) );
+			const ElfW( Sym ) *symbols = file.Get<ElfW( Sym )>( section.sh_offset, count );
+			if( strings == nullptr || symbols == nullptr )
+				continue;
+
+			for( size_t s = 0; s < count; ++s )
+			{
+				const ElfW( Sym ) &symbol = symbols[s];
+				if( IsIndexable( symbol, strings, strings_section.sh_size ) )
+					Insert( strings + symbol.st_name, base + symbol.st_value, DETOURING_ELF_ST_BIND( symbol.st_info ) != STB_LOCAL );
+			}
+		}
+
+		if( is_debug_file || debug_link.name.empty( ) )
+			return true;
+
+		const size_t slash = file_path.find_last_of( '/' );
+		const std::string directory = slash != std::string::npos ? file_path.substr( 0, slash ) : ".";
+
+		std::vector<std::string> candidates;
+		if( debug_link.build_id.size( ) > 1 )
+		{
+			const std::string build_id = ToHexadecimal( debug_link.build_id );
+			candidates.push_back(
+				"/usr/lib/debug/.build-id/" + build_id.substr( 0, 2 ) + "/" + build_id.substr( 2 ) + ".debug"
+			);
+		}
+
+		candidates.push_back( directory + "/" + debug_link.name );
+		candidates.push_back( directory + "/.debug/" + debug_link.name );
+		candidates.push_back( "/usr/lib/debug" + directory + "/" + debug_link.name );
+
+		for( const std::string &candidate : candidates )
+		{
+			if( candidate == file_path )
+				continue;
+
+			// Make sure the companion file belongs to this exact build before trusting its addresses
+			{
+				MappedFile debug_file( candidate );
+				const ElfW( Ehdr ) *debug_header = debug_file.Get<ElfW( Ehdr )>( 0 );
+				if( debug_header == nullptr )
+					continue;
+
+				std::string debug_build_id;
+				const ElfW( Shdr ) *debug_sections =
+					debug_file.Get<ElfW( Shdr )>( debug_header->e_shoff, debug_header->e_shnum );
+				for( size_t k = 0; debug_sections != nullptr && k < debug_header->e_shnum; ++k )
+				{
+					const ElfW( Shdr ) &section = debug_sections[k];
+					const uint8_t *notes = section.sh_type == SHT_NOTE ?
+						debug_file.Get<uint8_t>( section.sh_offset, section.sh_size ) : nullptr;
+					if( notes != nullptr && GetBuildId( notes, section.sh_size, debug_build_id ) )
+						break;
+				}
+
+				if( !debug_link.build_id.empty( ) && !debug_build_id.empty( ) )
+				{
+					if( debug_build_id != debug_link.build_id )
+						continue;
+				}
+				else if( GetCRC32( debug_file.data, debug_file.size ) != debug_link.crc )
+					continue;
+			}
+
+			if( Load( candidate, true ) )
+				break;
+		}
+
+		return true;
+
+#else
+
+		(void)file_path;
+		(void)is_debug_file;
+		return false;
+
+#endif
+
+	}
+
+	static bool ResolveSymbols(
+		const Hook::Module *module,
+		const std::vector<std::string> &names,
+		std::vector<void *> &addresses,
+		std::vector<std::string> *unresolved
+	)
+	{
+		addresses.assign( names.size( ), nullptr );
+
+		ModuleInfo scope;
+		if( module != nullptr && !GetModuleInfo( *module, scope ) )
+		{
+			if( unresolved != nullptr )
+				unresolved->insert( unresolved->end( ), names.begin( ), names.end( ) );
+
+			return names.empty( );
+		}
+
+#if defined SYSTEM_LINUX
+
+		std::vector<uint32_t> hashes( names.size( ) );
+		for( size_t k = 0; k < names.size( ); ++k )
+			hashes[k] = GetGNUHash( names[k].c_str( ) );
+
+		// The loader lock is only taken once, instead of once per dlsym call
+		SymbolSearch search = { module == nullptr, scope.base, names, hashes, addresses, { }, names.size( ) };
+		dl_iterate_phdr( ResolveInModule, &search );
+
+		// The module is kept loaded while its resolver runs, and the name is
+		// left unresolved if it went away in between
+		for( const IndirectSymbol &symbol : search.indirect )
+		{
+			void *handle = dlopen( symbol.path.empty( ) ? nullptr : symbol.path.c_str( ), RTLD_LAZY | RTLD_NOLOAD );
+			addresses[symbol.index] = handle != nullptr ?
+				reinterpret_cast<void *( * )( )>( symbol.resolver )( ) : nullptr;
+
+			if( handle != nullptr )
+				dlclose( handle );
+		}
+
+#elif defined SYSTEM_WINDOWS
+
+		std::vector<ModuleInfo> modules;
+		if( module != nullptr )
+			modules.push_back( scope );
+		else
+			modules = GetLoadedModules( );
+
+		for( const ModuleInfo &info : modules )
+			for( size_t k = 0; k < names.size( ); ++k )
+				if( addresses[k] == nullptr )
+					addresses[k] = reinterpret_cast<void *>( GetProcAddress(
+						reinterpret_cast<HMODULE>( info.base ), names[k].c_str( )
+					) );
+
+#elif defined SYSTEM_MACOSX
+
+		void *handle = RTLD_DEFAULT;
+		if( module != nullptr )
+			handle = module->IsPointer( ) ?
+				module->GetPointer( ) : dlopen( scope.path.c_str( ), RTLD_LAZY | RTLD_NOLOAD );
+
+		for( size_t k = 0; handle != nullptr && k < names.size( ); ++k )
+			addresses[k] = dlsym( handle, names[k].c_str( ) );
+
+		if( module != nullptr && !module->IsPointer( ) && handle != nullptr )
+			dlclose( handle );
+
+#endif
+
+		bool resolved = true;
+		for( size_t k = 0; k < names.size( ); ++k )
+			if( addresses[k] == nullptr )
+			{
+				resolved = false;
+				if( unresolved != nullptr )
+					unresolved->push_back( names[k] );
+			}
+
+		return resolved;
+	}
+
+	bool ResolveSymbols(
+		const std::vector<std::string> &names,
+		std::vector<void *> &addresses,
+		std::vector<std::string> *unresolved
+	)
+	{
+		return ResolveSymbols( nullptr, names, addresses, unresolved );
+	}
+
+	bool ResolveSymbols(
+		const Hook::Module &module,
+		const std::vector<std::string> &names,
+		std::vector<void *> &addresses,
+		std::vector<std::string> *unresolved
+	)
+	{
+		return ResolveSymbols( &module, names, addresses, unresolved );
+	}
+}
@@ -0,0 +1,339 @@
+/*************************************************************************
+* Detouring::HookTransaction
+* A C++ class that allows you to create, enable and disable many
+* Detouring::Hook objects in a single patching pass.
+*------------------------------------------------------------------------
+* Copyright (c) 2017-2022, Daniel Almeida
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions
+* are met:
+*
+* 1. Redistributions of source code must retain the above copyright
+* notice, this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright
+* notice, this list of conditions and the following disclaimer in the
+* documentation and/or other materials provided with the distribution.
+*
+* 3. Neither the name of the copyright holder nor the names of its
+* contributors may be used to endorse or promote products derived from
+* this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+* "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+* LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+* A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+* HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+* SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+* LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+* THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*************************************************************************/
+
+#include "transaction.hpp"
+#include "registry.hpp"
+#include "commit.hpp"
+#include "freeze.hpp"
+#include "MinHook.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace Detouring
+{
+	static std::mutex &GetTransactionMutex( )
+	{
+		static std::mutex transaction_mutex;
+		return transaction_mutex;
+	}
+
+	static bool QueueHookState( void *target, bool enable )
+	{
+		std::lock_guard lock( GetMinHookMutex( ) );
+		return ( enable ? MH_QueueEnableHook( target ) : MH_QueueDisableHook( target ) ) == MH_OK;
+	}
+
+	HookTransaction::~HookTransaction( )
+	{
+		Abort( );
+	}
+
+	bool HookTransaction::IsEmpty( ) const
+	{
+		return operations.empty( );
+	}
+
+	size_t HookTransaction::GetSize( ) const
+	{
+		return operations.size( );
+	}
+
+	bool HookTransaction::Create( Hook &hook, const Hook::Target &target, void *detour, bool enable )
+	{
+		if( hook.IsValid( ) || !target.IsValid( ) || detour == nullptr )
+			return false;
+
+		Operation operation;
+		operation.hook = &hook;
+		operation.enable = enable;
+		operation.create = true;
+		operation.target = target;
+		operation.detour = detour;
+		operations.push_back( std::move( operation ) );
+		return true;
+	}
+
+	bool HookTransaction::Create(
+		Hook &hook,
+		const Hook::Module &module,
+		const std::string &target,
+		void *detour,
+		bool enable
+	)
+	{
+		if( hook.IsValid( ) || !module.IsValid( ) || target.empty( ) || detour == nullptr )
+			return false;
+
+		Operation operation;
+		operation.hook = &hook;
+		operation.enable = enable;
+		operation.create = true;
+		operation.module = module;
+		operation.symbol = target;
+		operation.detour = detour;
+		operations.push_back( std::move( operation ) );
+		return true;
+	}
+
+	bool HookTransaction::Enable( Hook &hook )
+	{
+		return Queue( hook, true );
+	}
+
+	bool HookTransaction::Disable( Hook &hook )
+	{
+		return Queue( hook, false );
+	}
+
+	void HookTransaction::Adopt( std::unique_ptr<Hook> hook, AdoptCallback committed )
+	{
+		if( hook )
+			adopted.push_back( { std::move( hook ), std::move( committed ) } );
+	}
+
+	bool HookTransaction::Commit( )
+	{
+		if( operations.empty( ) && adopted.empty( ) )
+			return true;
+
+		std::lock_guard lock( GetTransactionMutex( ) );
+
+		struct State
+		{
+			Hook *hook;
+			void *address;
+			bool enabled;
+			bool enable;
+
+			// Toggled through CommitHookCode instead of MinHook's queue
+			bool committed;
+			uint8_t original[HookCodeSize];
+		};
+
+		std::vector<Hook *> created;
+		std::vector<State> states;
+		std::unordered_map<void *, size_t> indices;
+
+		// Undone with the same freeze as the forward path, since the hooks
+		// enabled again may have threads running inside their targets
+		const auto rollback = [this, &created, &states]( size_t queued )
+		{
+			std::vector<FrozenCode> jumps;
+			for( size_t k = 0; k < queued; ++k )
+			{
+				State &state = states[k];
+				if( state.hook->IsSoft( ) || state.committed )
+					continue;
+
+				if( state.enabled && !state.enable )
+				{
+					ReadHookCode( state.address, state.original );
+					jumps.push_back( { state.address, state.original, HookJumpSize } );
+				}
+
+				QueueHookState( state.address, state.enabled );
+			}
+
+			{
+				std::lock_guard lock( GetMinHookMutex( ) );
+				ThreadFreeze freeze;
+				freeze.Freeze( jumps.data( ), jumps.size( ) );
+				MH_ApplyQueued( );
+
+				for( size_t k = 0; k < queued; ++k )
+				{
+					const State &state = states[k];
+					if( state.enabled && !state.enable && !state.committed && !state.hook->IsSoft( ) )
+					{
+						const FrozenCode patched = { state.address, state.original, CompareHookCode( state.address, state.original ) };
+						freeze.RelocateThreads( patched, state.hook->GetTrampoline( ) );
+					}
+				}
+			}
+
+			for( Hook *hook : created )
+				hook->Destroy( );
+
+			operations.clear( );
+			adopted.clear( );
+			return false;
+		};
+
+		for( Operation &operation : operations )
+		{
+			void *address = operation.address;
+			if( operation.create )
+			{
+				const bool success = operation.module.IsValid( ) ?
+					operation.hook->Create( operation.module, operation.symbol, operation.detour ) :
+					operation.hook->Create( operation.target, operation.detour );
+				if( !success )
+					return rollback( 0 );
+
+				created.push_back( operation.hook );
+				address = operation.hook->GetTarget( );
+			}
+			else if( address == nullptr )
+				address = operation.hook->GetTarget( );
+
+			if( address == nullptr )
+				return rollback( 0 );
+
+			const auto it = indices.find( address );
+			if( it != indices.end( ) )
+			{
+				states[it->second].enable = operation.enable;
+				continue;
+			}
+
+			indices.emplace( address, states.size( ) );
+			states.push_back( { operation.hook, address, HookRegistry::IsEnabled( address ), operation.enable, false, { } } );
+		}
+
+		bool changed = false;
+		std::vector<HookCodeChange> changes;
+		std::vector<FrozenCode> jumps;
+		for( size_t k = 0; k < states.size( ); ++k )
+		{
+			// Soft hooks are already patched and only flip their gates once this succeeds
+			State &state = states[k];
+			if( state.enabled == state.enable || state.hook->IsSoft( ) )
+				continue;
+
+			if( HasHookCode( state.address ) )
+			{
+				state.committed = true;
+				changes.push_back( { state.address, state.enable } );
+				continue;
+			}
+
+			if( state.enable )
+			{
+				ReadHookCode( state.address, state.original );
+				jumps.push_back( { state.address, state.original, HookJumpSize } );
+			}
+
+			if( !QueueHookState( state.address, state.enable ) )
+				return rollback( k );
+
+			changed = true;
+		}
+
+		// Threads caught inside the jumps of enabled hooks continue in their
+		// trampolines. When they cannot be stopped, MinHook patches them
+		// running as before. The MinHook mutex is held first, so none of
+		// them is inside MinHook.
+		if( changed )
+		{
+			std::unique_lock lock( GetMinHookMutex( ) );
+			ThreadFreeze freeze;
+			freeze.Freeze( jumps.data( ), jumps.size( ) );
+			if( MH_ApplyQueued( ) != MH_OK )
+			{
+				freeze.Release( );
+				lock.unlock( );
+				return rollback( states.size( ) );
+			}
+
+			for( const State &state : states )
+				if( state.enable && !state.enabled && !state.committed && !state.hook->IsSoft( ) )
+				{
+					const FrozenCode patched = { state.address, state.original, CompareHookCode( state.address, state.original ) };
+					freeze.RelocateThreads( patched, state.hook->GetTrampoline( ) );
+				}
+		}
+
+		if( !changes.empty( ) && !CommitHookCode( changes.data( ), changes.size( ) ) )
+			return rollback( states.size( ) );
+
+		for( const State &state : states )
+		{
+			if( state.enabled == state.enable )
+				continue;
+
+			if( state.hook->IsSoft( ) )
+				state.enable ? state.hook->Enable( ) : state.hook->Disable( );
+			else
+			{
+				if( state.enable && !state.committed )
+					RecordHookCode( state.address, state.hook->GetTrampoline( ), state.original );
+
+				HookRegistry::SetEnabled( state.address, state.enable );
+			}
+		}
+
+		operations.clear( );
+
+		// Handed over last, so callbacks see every hook in its final state
+		std::vector<Adopted> committed = std::move( adopted );
+		adopted.clear( );
+		for( Adopted &entry : committed )
+			if( entry.committed )
+				entry.committed( std::move( entry.hook ) );
+
+		return true;
+	}
+
+	void HookTransaction::Abort( )
+	{
+		operations.clear( );
+		adopted.clear( );
+	}
+
+	bool HookTransaction::Queue( Hook &hook, bool enable )
+	{
+		Operation operation;
+		operation.hook = &hook;
+		operation.address = hook.GetTarget( );
+		operation.enable = enable;
+
+		if( operation.address == nullptr )
+		{
+			bool queued = false;
+			for( const Operation &other : operations )
+				if( other.create && other.hook == &hook )
+					queued = true;
+
+			if( !queued )
+				return false;
+		}
+
+		operations.push_back( std::move( operation ) );
+		return true;
+	}
+}